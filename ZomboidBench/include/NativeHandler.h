@@ -0,0 +1,63 @@
+#pragma once
+
+#include <fstream>
+#include <unordered_map>
+
+#include "StdFileOps.h"
+#include "interface/IOSCallHandler.h"
+
+namespace ZomboidBench {
+	using namespace ZomboidHook;
+
+	// Does every call straight on the filesystem through the standard library,
+	// as the game would without the hook. It is the baseline for replays.
+	class NativeHandler : public IOSCallHandler {
+		std::unordered_map<int64_t, std::fstream> files;
+		StdFileOps fileOps;
+
+		FileIntent
+				Open(FileInfo info, bool mayExist, bool mayBeMissing, bool wipe);
+		std::fstream* Find(int64_t handle);
+
+	public:
+		[[nodiscard]] bool MayIntercept(PathView path) const noexcept override;
+		[[nodiscard]] FileIntent FileOpenOnly(FileInfo info) override;
+		[[nodiscard]] FileIntent FileCreateOnly(FileInfo info) override;
+		[[nodiscard]] FileIntent FileOpenOrCreate(FileInfo info) override;
+		[[nodiscard]] FileIntent FileCreateAndWipe(FileInfo info) override;
+		[[nodiscard]] FileIntent FileOpenOnlyAndWipe(FileInfo info) override;
+		[[nodiscard]] FileIntent
+				FileRead(FileInfo info, uint8_t* buf, uint32_t& readLen) override;
+		[[nodiscard]] FileIntent FileWrite(FileInfo info,
+																			 const uint8_t* buf,
+																			 uint32_t& writeLen) override;
+		[[nodiscard]] FileIntent FileReadAt(FileInfo info,
+																				uint8_t* buf,
+																				uint32_t& readLen,
+																				uint64_t offset) override;
+		[[nodiscard]] FileIntent FileWriteAt(FileInfo info,
+																				 const uint8_t* buf,
+																				 uint32_t& writeLen,
+																				 uint64_t offset) override;
+		[[nodiscard]] FileIntent FileAppend(FileInfo info,
+																				const uint8_t* buf,
+																				uint32_t& writeLen) override;
+		[[nodiscard]] FileIntent FileFlush(FileInfo info) override;
+		[[nodiscard]] FileIntent
+				FileSeek(FileInfo info, SeekFrom pos, int64_t& distance) override;
+		[[nodiscard]] FileIntent FileTruncateToCursor(FileInfo info) override;
+		[[nodiscard]] FileIntent FileTruncate(FileInfo info, uint64_t len) override;
+		[[nodiscard]] FileIntent
+				FileDelete(const std::filesystem::path& path) override;
+		[[nodiscard]] FileIntent
+				FileSetAttrib(const std::filesystem::path& path) override;
+		[[nodiscard]] FileIntent FileGetSize(FileInfo info,
+																				 uint64_t& sizeOut,
+																				 bool isStateless) override;
+		[[nodiscard]] FileAttribute
+				FileGetAttrib(const std::filesystem::path& path) override;
+		[[nodiscard]] FileTimes
+				FileGetTimes(const std::filesystem::path& path) override;
+		void FileClosed(FileInfo info) override;
+	};
+} // namespace ZomboidBench
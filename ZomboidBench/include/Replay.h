@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "StdFileOps.h"
+#include "Trace.h"
+#include "interface/IOSCallHandler.h"
+
+namespace ZomboidBench {
+	using namespace ZomboidHook;
+
+	struct ReplayOptions {
+		std::filesystem::path trace;
+		std::filesystem::path dir =
+				std::filesystem::temp_directory_path() / "ZomboidBench";
+		bool native		= false; // Against the filesystem instead of the hook.
+		bool paced		= false; // Keeps the gaps between calls as recorded.
+		bool recorded = false; // Only reports the latencies in the trace.
+	};
+
+	// Plays a trace back on one thread, in the order the calls completed, and
+	// times each call. Save paths are moved under the scratch directory, and
+	// the files the trace finds already there are made up front, as large as
+	// the trace saw them, through the handler under test.
+	class Replay {
+		const ReplayOptions& options;
+		TraceReader reader;
+		std::vector<TraceRecord> records;
+		std::vector<std::filesystem::path> paths;
+		StdFileOps fileOps;
+		std::unique_ptr<IOSCallHandler> handler;
+		std::unordered_map<int64_t, int64_t> handles;
+		std::vector<int64_t> freeHandles;
+		int64_t nextHandle = 4;
+		std::vector<uint8_t> buf;
+
+		std::filesystem::path Remap(const std::filesystem::path& path) const;
+		int64_t Handle(int64_t recorded, bool opens);
+		void Seed();
+		// Returns whether the outcome matches the recorded one.
+		bool Play(const TraceRecord& record);
+
+	public:
+		explicit Replay(const ReplayOptions& options);
+		void Run(std::ostream& out);
+		~Replay();
+	};
+} // namespace ZomboidBench
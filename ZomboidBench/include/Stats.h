@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace ZomboidBench {
+	// Latencies of one kind of operation, each timed on its own so that the
+	// tail shows along with the mean.
+	class Stats {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+	private:
+		std::vector<Clock::duration> samples;
+		uint64_t bytes = 0;
+
+	public:
+		void Add(Clock::duration sample, uint64_t len) {
+			samples.push_back(sample);
+			bytes += len;
+		}
+
+		template <typename Fn>
+		void Time(uint64_t len, Fn&& fn) {
+			auto start = Clock::now();
+			fn();
+			Add(Clock::now() - start, len);
+		}
+
+		static void PrintHeader(std::ostream& out);
+		// One tab separated row, so that runs can be diffed and compared.
+		void Print(std::ostream& out,
+							 std::string_view op,
+							 size_t files,
+							 size_t fileSize);
+	};
+} // namespace ZomboidBench
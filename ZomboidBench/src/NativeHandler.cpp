@@ -0,0 +1,185 @@
+#include "NativeHandler.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidBench;
+
+std::fstream* NativeHandler::Find(int64_t handle) {
+	auto it = files.find(handle);
+	return it != files.end() ? &it->second : nullptr;
+}
+
+FileIntent NativeHandler::Open(FileInfo info,
+																 bool mayExist,
+																 bool mayBeMissing,
+																 bool wipe) {
+	std::error_code ec;
+	auto exists = fs::exists(info.path, ec);
+	if (exists ? !mayExist : !mayBeMissing)
+		return FileIntent::FAIL;
+	auto mode = std::ios::in | std::ios::out | std::ios::binary;
+	if (wipe || !exists)
+		mode |= std::ios::trunc;
+	std::fstream file{info.path, mode};
+	if (!file)
+		return FileIntent::FAIL;
+	files.insert_or_assign(info.handle, std::move(file));
+	return FileIntent::SUCCEED;
+}
+
+bool NativeHandler::MayIntercept(PathView) const noexcept {
+	return true;
+}
+
+FileIntent NativeHandler::FileOpenOnly(FileInfo info) {
+	return Open(info, true, false, false);
+}
+
+FileIntent NativeHandler::FileCreateOnly(FileInfo info) {
+	return Open(info, false, true, true);
+}
+
+FileIntent NativeHandler::FileOpenOrCreate(FileInfo info) {
+	return Open(info, true, true, false);
+}
+
+FileIntent NativeHandler::FileCreateAndWipe(FileInfo info) {
+	return Open(info, true, true, true);
+}
+
+FileIntent NativeHandler::FileOpenOnlyAndWipe(FileInfo info) {
+	return Open(info, true, false, true);
+}
+
+FileIntent
+NativeHandler::FileRead(FileInfo info, uint8_t* buf, uint32_t& readLen) {
+	auto file = Find(info.handle);
+	if (!file)
+		return FileIntent::FAIL;
+	file->read(reinterpret_cast<char*>(buf), readLen);
+	readLen = static_cast<uint32_t>(file->gcount());
+	file->clear(); // Reading up to the end is no error.
+	return FileIntent::SUCCEED;
+}
+
+FileIntent NativeHandler::FileWrite(FileInfo info,
+																		const uint8_t* buf,
+																		uint32_t& writeLen) {
+	auto file = Find(info.handle);
+	if (!file || !file->write(reinterpret_cast<const char*>(buf), writeLen))
+		return FileIntent::FAIL;
+	return FileIntent::SUCCEED;
+}
+
+// The stream's cursor is put back after, as pread() and pwrite() would.
+FileIntent NativeHandler::FileReadAt(FileInfo info,
+																		 uint8_t* buf,
+																		 uint32_t& readLen,
+																		 uint64_t offset) {
+	auto file = Find(info.handle);
+	if (!file)
+		return FileIntent::FAIL;
+	auto cursor = file->tellg();
+	if (!file->seekg(offset))
+		return FileIntent::FAIL;
+	file->read(reinterpret_cast<char*>(buf), readLen);
+	readLen = static_cast<uint32_t>(file->gcount());
+	file->clear();
+	file->seekg(cursor);
+	return FileIntent::SUCCEED;
+}
+
+FileIntent NativeHandler::FileWriteAt(FileInfo info,
+																			const uint8_t* buf,
+																			uint32_t& writeLen,
+																			uint64_t offset) {
+	auto file = Find(info.handle);
+	if (!file)
+		return FileIntent::FAIL;
+	auto cursor = file->tellp();
+	if (!file->seekp(offset) ||
+			!file->write(reinterpret_cast<const char*>(buf), writeLen))
+		return FileIntent::FAIL;
+	file->seekp(cursor);
+	return FileIntent::SUCCEED;
+}
+
+FileIntent NativeHandler::FileAppend(FileInfo info,
+																		 const uint8_t* buf,
+																		 uint32_t& writeLen) {
+	auto file = Find(info.handle);
+	if (!file || !file->seekp(0, std::ios::end) ||
+			!file->write(reinterpret_cast<const char*>(buf), writeLen))
+		return FileIntent::FAIL;
+	return FileIntent::SUCCEED;
+}
+
+FileIntent NativeHandler::FileFlush(FileInfo info) {
+	auto file = Find(info.handle);
+	return file && file->flush() ? FileIntent::SUCCEED : FileIntent::FAIL;
+}
+
+FileIntent
+NativeHandler::FileSeek(FileInfo info, SeekFrom pos, int64_t& distance) {
+	auto file = Find(info.handle);
+	if (!file)
+		return FileIntent::FAIL;
+	auto dir = pos == SeekFrom::BEGIN		? std::ios::beg
+						 : pos == SeekFrom::CURRENT ? std::ios::cur
+																				: std::ios::end;
+	if (!file->seekg(distance, dir))
+		return FileIntent::FAIL;
+	distance = file->tellg();
+	return FileIntent::SUCCEED;
+}
+
+FileIntent NativeHandler::FileTruncateToCursor(FileInfo info) {
+	auto file = Find(info.handle);
+	if (!file)
+		return FileIntent::FAIL;
+	return FileTruncate(info, file->tellp());
+}
+
+FileIntent NativeHandler::FileTruncate(FileInfo info, uint64_t len) {
+	auto file = Find(info.handle);
+	if (!file || !file->flush())
+		return FileIntent::FAIL;
+	std::error_code ec;
+	fs::resize_file(info.path, len, ec);
+	return ec ? FileIntent::FAIL : FileIntent::SUCCEED;
+}
+
+FileIntent NativeHandler::FileDelete(const fs::path& path) {
+	std::error_code ec;
+	return fs::remove(path, ec) ? FileIntent::SUCCEED : FileIntent::FAIL;
+}
+
+FileIntent NativeHandler::FileSetAttrib(const fs::path& path) {
+	std::error_code ec;
+	return fs::exists(path, ec) ? FileIntent::SUCCEED : FileIntent::FAIL;
+}
+
+FileIntent NativeHandler::FileGetSize(FileInfo info,
+																			uint64_t& sizeOut,
+																			bool isStateless) {
+	if (auto file = isStateless ? nullptr : Find(info.handle))
+		file->flush();
+	std::error_code ec;
+	sizeOut = fs::file_size(info.path, ec);
+	return ec ? FileIntent::FAIL : FileIntent::SUCCEED;
+}
+
+FileAttribute NativeHandler::FileGetAttrib(const fs::path& path) {
+	std::error_code ec;
+	auto status = fs::status(path, ec);
+	if (fs::is_directory(status))
+		return FileAttribute::DIRECTORY;
+	return fs::exists(status) ? FileAttribute::NORMAL : FileAttribute::NOT_FOUND;
+}
+
+FileTimes NativeHandler::FileGetTimes(const fs::path& path) {
+	return fileOps.GetFileTimes(path);
+}
+
+void NativeHandler::FileClosed(FileInfo info) {
+	files.erase(info.handle);
+}
@@ -0,0 +1,371 @@
+#include "Replay.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <string_view>
+#include <thread>
+
+#include "Config.h"
+#include "NativeHandler.h"
+#include "OSCallHandler.h"
+#include "Stats.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidBench;
+
+namespace {
+	constexpr std::array<std::string_view, 21> opNames{
+			"path",
+			"open_only",
+			"create_only",
+			"open_or_create",
+			"create_and_wipe",
+			"open_only_and_wipe",
+			"read",
+			"write",
+			"seek",
+			"truncate_to_cursor",
+			"truncate",
+			"delete",
+			"close",
+			"set_attrib",
+			"get_size",
+			"get_attrib",
+			"get_times",
+			"read_at",
+			"write_at",
+			"append",
+			"flush",
+	};
+
+	// Calls the frontend did on the OS itself are not the storage's doing.
+	bool Passthru(const TraceRecord& record) {
+		if (record.op == TraceOp::GET_ATTRIB)
+			return record.intent == static_cast<uint8_t>(FileAttribute::PASSTHRU);
+		return record.intent == static_cast<uint8_t>(FileIntent::PASSTHRU);
+	}
+
+	bool Opens(TraceOp op) {
+		return op >= TraceOp::OPEN_ONLY && op <= TraceOp::OPEN_ONLY_AND_WIPE;
+	}
+
+	// Calls whose result is the length read or written.
+	bool Transfers(TraceOp op) {
+		return op == TraceOp::READ || op == TraceOp::WRITE ||
+					 op == TraceOp::READ_AT || op == TraceOp::WRITE_AT ||
+					 op == TraceOp::APPEND;
+	}
+
+	// What the trace tells of a file as it was before the trace began.
+	struct Origin {
+		bool seen			= false;
+		bool exists		= false;
+		bool maybe		= false; // First opened by an open or create.
+		bool modified = false;
+		uint64_t size = 0;
+	};
+} // namespace
+
+Replay::Replay(const ReplayOptions& options) :
+		options{options}, reader{options.trace} {
+	uint32_t pathCount = 0;
+	while (auto record = reader.Next()) {
+		pathCount = std::max(pathCount, record->path + 1);
+		if (!Passthru(*record))
+			records.push_back(*record);
+	}
+	for (uint32_t i = 0; i < pathCount; ++i)
+		paths.push_back(Remap(reader.Path(i)));
+	if (options.recorded)
+		return;
+	fs::remove_all(options.dir);
+	for (auto& path : paths)
+		fs::create_directories(path.parent_path());
+	if (options.native)
+		handler = std::make_unique<NativeHandler>();
+	else
+		handler = std::make_unique<OSCallHandler>(fileOps,
+																							Config::FromEnvironment());
+	Seed();
+}
+
+// Keeps whatever follows the last "Saves" component, so that the router sees
+// the same save layout. Either separator is taken, so traces from the other
+// platform replay too.
+fs::path Replay::Remap(const fs::path& path) const {
+	auto name = path.u8string();
+	std::vector<std::u8string_view> parts;
+	for (std::u8string_view rest{name}; !rest.empty();) {
+		auto end = std::min(rest.find_first_of(u8"/\\"), rest.size());
+		if (end > 0)
+			parts.push_back(rest.substr(0, end));
+		rest.remove_prefix(std::min(end + 1, rest.size()));
+	}
+	auto saves = std::find(parts.rbegin(), parts.rend(), u8"Saves");
+	if (saves == parts.rend())
+		return options.dir / "Other" / fs::path{parts.back()};
+	auto out = options.dir;
+	for (auto it = saves.base() - 1; it != parts.end(); ++it)
+		out /= fs::path{*it};
+	return out;
+}
+
+// Recorded handles may be reused or be out of range here, so each open gets
+// one of ours, spaced as kernel handles are.
+int64_t Replay::Handle(int64_t recorded, bool opens) {
+	if (!opens) {
+		auto it = handles.find(recorded);
+		return it != handles.end() ? it->second : recorded;
+	}
+	int64_t handle;
+	if (!freeHandles.empty()) {
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	} else {
+		handle = nextHandle += 4;
+	}
+	if (auto [it, added] = handles.try_emplace(recorded, handle); !added) {
+		freeHandles.push_back(it->second);
+		it->second = handle;
+	}
+	return handle;
+}
+
+void Replay::Seed() {
+	std::vector<Origin> origins(paths.size());
+	std::unordered_map<int64_t, uint64_t> cursors;
+	size_t maxLen = 1 << 16;
+	for (auto& record : records) {
+		auto& origin = origins[record.path];
+		auto ok			 = record.intent == static_cast<uint8_t>(FileIntent::SUCCEED);
+		if (!origin.seen) {
+			origin.seen = true;
+			switch (record.op) {
+				case TraceOp::OPEN_ONLY:
+				case TraceOp::OPEN_ONLY_AND_WIPE:
+				case TraceOp::DELETE:
+				case TraceOp::SET_ATTRIB:
+				case TraceOp::GET_SIZE:
+					origin.exists = ok;
+					break;
+				case TraceOp::OPEN_OR_CREATE:
+					origin.maybe = ok;
+					break;
+				case TraceOp::GET_ATTRIB:
+					origin.exists =
+							record.intent == static_cast<uint8_t>(FileAttribute::NORMAL);
+					break;
+				default:
+					break;
+			}
+		}
+		if (Transfers(record.op)) { // Calls at an offset only keep what was done.
+			auto at = record.op == TraceOp::READ_AT || record.op == TraceOp::WRITE_AT;
+			maxLen	= std::max<size_t>(maxLen, at ? record.result : record.arg);
+		}
+		if (!ok)
+			continue;
+		switch (record.op) {
+			case TraceOp::OPEN_ONLY:
+			case TraceOp::OPEN_OR_CREATE:
+				cursors[record.handle] = 0;
+				break;
+			case TraceOp::READ:
+			case TraceOp::WRITE:
+				if (auto it = cursors.find(record.handle); it != cursors.end()) {
+					it->second += record.result;
+					if (record.op == TraceOp::WRITE)
+						origin.modified = true;
+					else if (!origin.modified)
+						origin.size = std::max(origin.size, it->second);
+				}
+				break;
+			case TraceOp::READ_AT:
+				if (!origin.modified)
+					origin.size = std::max<uint64_t>(origin.size,
+																					 record.arg + record.result);
+				break;
+			case TraceOp::SEEK:
+				if (auto it = cursors.find(record.handle); it != cursors.end())
+					it->second = record.result;
+				break;
+			case TraceOp::GET_SIZE:
+				if (!origin.modified)
+					origin.size = std::max<uint64_t>(origin.size, record.result);
+				break;
+			case TraceOp::CLOSED:
+				cursors.erase(record.handle);
+				break;
+			case TraceOp::SET_ATTRIB:
+			case TraceOp::GET_ATTRIB:
+			case TraceOp::GET_TIMES:
+			case TraceOp::FLUSH:
+				break;
+			default: // Creates, wipes, writes elsewhere, truncates and deletes.
+				origin.modified = true;
+				break;
+		}
+	}
+
+	buf.resize(maxLen);
+	for (size_t i = 0; i < buf.size(); ++i)
+		buf[i] = static_cast<uint8_t>(i * 131 + (i >> 8));
+	for (uint32_t id = 0; id < paths.size(); ++id) {
+		auto& origin = origins[id];
+		if (!origin.exists && !(origin.maybe && origin.size > 0))
+			continue;
+		FileInfo info{paths[id], nextHandle};
+		if (handler->FileCreateAndWipe(info) != FileIntent::SUCCEED)
+			throw std::runtime_error{"Failed to seed " + paths[id].string()};
+		for (uint64_t done = 0; done < origin.size;) {
+			auto len = static_cast<uint32_t>(
+					std::min<uint64_t>(buf.size(), origin.size - done));
+			if (handler->FileWrite(info, buf.data(), len) != FileIntent::SUCCEED)
+				throw std::runtime_error{"Failed to seed " + paths[id].string()};
+			done += len;
+		}
+		handler->FileClosed(info);
+	}
+}
+
+bool Replay::Play(const TraceRecord& record) {
+	auto opens = Opens(record.op) &&
+							 record.intent == static_cast<uint8_t>(FileIntent::SUCCEED);
+	FileInfo info{paths[record.path], Handle(record.handle, opens)};
+	auto intent = FileIntent::SUCCEED;
+	int64_t result = 0;
+	switch (record.op) {
+		case TraceOp::OPEN_ONLY:
+			intent = handler->FileOpenOnly(info);
+			break;
+		case TraceOp::CREATE_ONLY:
+			intent = handler->FileCreateOnly(info);
+			break;
+		case TraceOp::OPEN_OR_CREATE:
+			intent = handler->FileOpenOrCreate(info);
+			break;
+		case TraceOp::CREATE_AND_WIPE:
+			intent = handler->FileCreateAndWipe(info);
+			break;
+		case TraceOp::OPEN_ONLY_AND_WIPE:
+			intent = handler->FileOpenOnlyAndWipe(info);
+			break;
+		case TraceOp::READ: {
+			auto len = static_cast<uint32_t>(record.arg);
+			intent	 = handler->FileRead(info, buf.data(), len);
+			result	 = len;
+			break;
+		}
+		case TraceOp::WRITE: {
+			auto len = static_cast<uint32_t>(record.arg);
+			intent	 = handler->FileWrite(info, buf.data(), len);
+			result	 = len;
+			break;
+		}
+		case TraceOp::READ_AT: {
+			auto len = static_cast<uint32_t>(record.result);
+			intent	 = handler->FileReadAt(info, buf.data(), len, record.arg);
+			result	 = len;
+			break;
+		}
+		case TraceOp::WRITE_AT: {
+			auto len = static_cast<uint32_t>(record.result);
+			intent	 = handler->FileWriteAt(info, buf.data(), len, record.arg);
+			result	 = len;
+			break;
+		}
+		case TraceOp::APPEND: {
+			auto len = static_cast<uint32_t>(record.arg);
+			intent	 = handler->FileAppend(info, buf.data(), len);
+			result	 = len;
+			break;
+		}
+		case TraceOp::FLUSH:
+			intent = handler->FileFlush(info);
+			break;
+		case TraceOp::SEEK:
+			result = record.arg;
+			intent = handler->FileSeek(
+					info, static_cast<SeekFrom>(record.mode), result);
+			break;
+		case TraceOp::TRUNCATE_TO_CURSOR:
+			intent = handler->FileTruncateToCursor(info);
+			break;
+		case TraceOp::TRUNCATE:
+			intent = handler->FileTruncate(info, record.arg);
+			break;
+		case TraceOp::DELETE:
+			intent = handler->FileDelete(info.path);
+			break;
+		case TraceOp::CLOSED:
+			handler->FileClosed(info);
+			if (auto it = handles.find(record.handle); it != handles.end()) {
+				freeHandles.push_back(it->second);
+				handles.erase(it);
+			}
+			break;
+		case TraceOp::SET_ATTRIB:
+			intent = handler->FileSetAttrib(info.path);
+			break;
+		case TraceOp::GET_SIZE: {
+			uint64_t size = 0;
+			intent = handler->FileGetSize(info, size, record.mode);
+			result = intent == FileIntent::SUCCEED ? size : 0;
+			break;
+		}
+		case TraceOp::GET_ATTRIB:
+			intent = static_cast<FileIntent>(handler->FileGetAttrib(info.path));
+			break;
+		case TraceOp::GET_TIMES:
+			static_cast<void>(handler->FileGetTimes(info.path));
+			return true;
+		case TraceOp::PATH:
+			return true;
+	}
+	// Reads past the size a seeded file was given may come up short, so only
+	// the intent and the lengths that follow from the calls alone count.
+	auto sameResult = Transfers(record.op) || record.op == TraceOp::SEEK ||
+										record.op == TraceOp::GET_SIZE;
+	return static_cast<uint8_t>(intent) == record.intent &&
+				 (!sameResult || result == record.result);
+}
+
+void Replay::Run(std::ostream& out) {
+	std::array<Stats, opNames.size()> stats;
+	size_t differ = 0;
+	auto start		= Stats::Clock::now();
+	for (auto& record : records) {
+		auto op = static_cast<size_t>(record.op);
+		if (op >= stats.size()) [[unlikely]]
+			throw std::runtime_error{"Unknown call in trace"};
+		uint64_t len = 0;
+		if (Transfers(record.op))
+			len = record.result;
+		if (options.recorded) {
+			stats[op].Add(std::chrono::nanoseconds{record.latency}, len);
+			continue;
+		}
+		if (options.paced)
+			std::this_thread::sleep_until(start +
+																		std::chrono::nanoseconds{record.time});
+		stats[op].Time(len, [&] { differ += !Play(record); });
+	}
+	auto wall = std::chrono::duration<double>{Stats::Clock::now() - start};
+
+	Stats::PrintHeader(out);
+	for (size_t op = 0; op < stats.size(); ++op)
+		stats[op].Print(out, opNames[op], paths.size(), 0);
+	out << "# " << records.size() << " calls";
+	if (!options.recorded)
+		out << " replayed in " << wall.count() << " s, " << differ
+				<< " with another outcome than recorded";
+	out << '\n';
+}
+
+Replay::~Replay() {
+	handler.reset();
+	std::error_code ec;
+	if (!options.recorded)
+		fs::remove_all(options.dir, ec);
+}
@@ -0,0 +1,34 @@
+#include "Stats.h"
+
+#include <algorithm>
+
+using namespace ZomboidBench;
+
+void Stats::PrintHeader(std::ostream& out) {
+	out << "op\tfiles\tsize\tops\tmean_us\tp50_us\tp99_us\tmax_us\tops_s"
+				 "\tMiB_s\n";
+}
+
+void Stats::Print(std::ostream& out,
+									std::string_view op,
+									size_t files,
+									size_t fileSize) {
+	if (samples.empty())
+		return;
+	std::sort(samples.begin(), samples.end());
+	Clock::duration total{};
+	for (auto sample : samples)
+		total += sample;
+	auto micros = [](Clock::duration d) {
+		return std::chrono::duration<double, std::micro>{d}.count();
+	};
+	auto seconds = std::chrono::duration<double>{total}.count();
+	auto at			 = [&](double q) {
+		return samples[static_cast<size_t>(q * (samples.size() - 1))];
+	};
+	out << op << '\t' << files << '\t' << fileSize << '\t' << samples.size()
+			<< '\t' << micros(total) / samples.size() << '\t' << micros(at(0.5))
+			<< '\t' << micros(at(0.99)) << '\t' << micros(samples.back()) << '\t'
+			<< samples.size() / seconds << '\t' << bytes / seconds / (1 << 20)
+			<< '\n';
+}
@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Config.h"
+#include "OSCallHandler.h"
+#include "Replay.h"
+#include "StdFileOps.h"
+#include "Stats.h"
+
+#include "sqlite3.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+using namespace ZomboidBench;
+
+namespace {
+	struct Options {
+		std::vector<size_t> files{1000, 10000};
+		std::vector<size_t> sizes{4 << 10, 64 << 10, 512 << 10};
+		size_t ops				= 2000;
+		uint64_t maxBytes = 1ull << 30; // Rounds storing more are skipped.
+		uint32_t ioSize		= 4096;				// Of each read or write call.
+		fs::path dir			= fs::temp_directory_path() / "ZomboidBench";
+	};
+
+	std::vector<size_t> ParseList(std::string_view arg) {
+		std::vector<size_t> list;
+		while (!arg.empty()) {
+			size_t value	 = 0;
+			auto [end, ec] =
+					std::from_chars(arg.data(), arg.data() + arg.size(), value);
+			if (ec == std::errc{} && value > 0)
+				list.push_back(value);
+			arg.remove_prefix(std::min<size_t>(end - arg.data() + 1, arg.size()));
+		}
+		return list;
+	}
+
+	template <typename T>
+	void ParseNumber(std::string_view arg, T& out) {
+		std::from_chars(arg.data(), arg.data() + arg.size(), out);
+	}
+
+	// Drives an OSCallHandler the way the hooks do, for one save directory of
+	// files files of size bytes each. Handles are made up, spaced as kernel
+	// handles are so that they suit the registry on either platform.
+	class Round {
+		const Options& options;
+		size_t files;
+		size_t size;
+		fs::path saveDir;
+		StdFileOps fileOps;
+		std::unique_ptr<OSCallHandler> handler;
+		std::mt19937_64 rng{files * 31 + size};
+		std::vector<uint8_t> buf;
+		int64_t nextHandle = 4;
+
+		fs::path FilePath(size_t i) const {
+			auto x = std::to_string(i % 1000);
+			auto y = std::to_string(i / 1000);
+			return saveDir / ("map_" + x + '_' + y + ".bin");
+		}
+
+		fs::path RandomFile() {
+			return FilePath(rng() % files);
+		}
+
+		int64_t Handle() {
+			nextHandle += 4;
+			return nextHandle;
+		}
+
+		// Unique contents, so that deduplication cannot make writes free.
+		void Fill(size_t len) {
+			buf.resize(len);
+			for (size_t i = 0; i < len; i += sizeof(uint64_t)) {
+				auto word = rng();
+				std::copy_n(reinterpret_cast<uint8_t*>(&word),
+										std::min(sizeof(word), len - i),
+										buf.data() + i);
+			}
+		}
+
+		static void Check(bool ok, const char* what) {
+			if (!ok) [[unlikely]]
+				throw std::runtime_error{what};
+		}
+
+		void Write(const fs::path& path, int64_t handle, size_t len) {
+			for (size_t done = 0; done < len;) {
+				auto chunk = static_cast<uint32_t>(
+						std::min<size_t>(options.ioSize, len - done));
+				Check(handler->FileWrite({path, handle}, buf.data() + done, chunk) ==
+									FileIntent::SUCCEED,
+							"write failed");
+				done += chunk;
+			}
+		}
+
+		void Read(const fs::path& path, int64_t handle, uint32_t& len) {
+			Check(handler->FileRead({path, handle}, buf.data(), len) ==
+								FileIntent::SUCCEED,
+						"read failed");
+		}
+
+		void Close(const fs::path& path, int64_t handle) {
+			handler->FileClosed({path, handle});
+		}
+
+	public:
+		Round(const Options& options, size_t files, size_t size) :
+				options{options},
+				files{files},
+				size{size},
+				saveDir{options.dir / "Saves" / "Sandbox" / "bench"} {
+			fs::remove_all(options.dir);
+			fs::create_directories(saveDir);
+			handler = std::make_unique<OSCallHandler>(fileOps,
+																								Config::FromEnvironment());
+		}
+
+		void Run(std::ostream& out) {
+			auto print = [&](Stats& stats, std::string_view op) {
+				stats.Print(out, op, files, size);
+			};
+			Stats create;
+			for (size_t i = 0; i < files; ++i) {
+				auto path		= FilePath(i);
+				auto handle = Handle();
+				Fill(size);
+				create.Time(size, [&] {
+					Check(handler->FileCreateAndWipe({path, handle}) ==
+										FileIntent::SUCCEED,
+								"create failed");
+					Write(path, handle, size);
+					Close(path, handle);
+				});
+			}
+			print(create, "create");
+
+			Stats open;
+			for (size_t i = 0; i < options.ops; ++i) {
+				auto path		= RandomFile();
+				auto handle = Handle();
+				open.Time(0, [&] {
+					Check(handler->FileOpenOnly({path, handle}) == FileIntent::SUCCEED,
+								"open failed");
+				});
+				Close(path, handle);
+			}
+			print(open, "open");
+
+			Stats stat;
+			for (size_t i = 0; i < options.ops; ++i) {
+				auto path = RandomFile();
+				stat.Time(0, [&] {
+					uint64_t len;
+					Check(handler->FileGetSize({path, -1}, len, true) ==
+												FileIntent::SUCCEED &&
+										handler->FileGetAttrib(path) == FileAttribute::NORMAL,
+								"stat failed");
+				});
+			}
+			print(stat, "stat");
+
+			Stats statMissing;
+			for (size_t i = 0; i < options.ops; ++i) {
+				auto path = FilePath(files + rng() % files);
+				statMissing.Time(0, [&] {
+					Check(handler->FileGetAttrib(path) == FileAttribute::NOT_FOUND,
+								"stat of a missing file failed");
+				});
+			}
+			print(statMissing, "stat_missing");
+
+			buf.resize(std::max<size_t>(size, options.ioSize));
+			Stats seqRead;
+			for (size_t i = 0; i < std::min(options.ops, files); ++i) {
+				auto path		= RandomFile();
+				auto handle = Handle();
+				Check(handler->FileOpenOnly({path, handle}) == FileIntent::SUCCEED,
+							"open failed");
+				seqRead.Time(size, [&] {
+					for (size_t done = 0; done < size;) {
+						auto len = options.ioSize;
+						Read(path, handle, len);
+						Check(len > 0, "short read");
+						done += len;
+					}
+				});
+				Close(path, handle);
+			}
+			print(seqRead, "seq_read");
+
+			Stats seek;
+			Stats randRead;
+			{
+				auto path		= RandomFile();
+				auto handle = Handle();
+				Check(handler->FileOpenOnly({path, handle}) == FileIntent::SUCCEED,
+							"open failed");
+				auto slots = std::max<size_t>(size / options.ioSize, 1);
+				for (size_t i = 0; i < options.ops; ++i) {
+					int64_t offset = (rng() % slots) * options.ioSize;
+					seek.Time(0, [&] {
+						Check(handler->FileSeek({path, handle}, SeekFrom::BEGIN, offset) ==
+											FileIntent::SUCCEED,
+									"seek failed");
+					});
+					auto len = options.ioSize;
+					randRead.Time(len, [&] { Read(path, handle, len); });
+				}
+				Close(path, handle);
+			}
+			print(seek, "seek");
+			print(randRead, "rand_read");
+
+			Stats append;
+			Fill(options.ioSize);
+			for (size_t i = 0; i < options.ops; ++i) {
+				auto path		= RandomFile();
+				auto handle = Handle();
+				append.Time(options.ioSize, [&] {
+					Check(handler->FileOpenOrCreate({path, handle}) ==
+										FileIntent::SUCCEED,
+								"open failed");
+					int64_t end = 0;
+					Check(handler->FileSeek({path, handle}, SeekFrom::END, end) ==
+										FileIntent::SUCCEED,
+								"seek failed");
+					Write(path, handle, options.ioSize);
+					Close(path, handle);
+				});
+			}
+			print(append, "append");
+
+			Stats truncate;
+			for (size_t i = 0; i < options.ops; ++i) {
+				auto path		= RandomFile();
+				auto handle = Handle();
+				truncate.Time(0, [&] {
+					Check(handler->FileOpenOnly({path, handle}) == FileIntent::SUCCEED &&
+										handler->FileTruncate({path, handle}, size / 2) ==
+												FileIntent::SUCCEED,
+								"truncate failed");
+					Close(path, handle);
+				});
+			}
+			print(truncate, "truncate");
+
+			Stats remove;
+			for (size_t i = 0; i < std::min(options.ops, files); ++i) {
+				auto path = FilePath(i);
+				remove.Time(0, [&] {
+					Check(handler->FileDelete(path) == FileIntent::SUCCEED,
+								"delete failed");
+				});
+			}
+			print(remove, "delete");
+		}
+
+		~Round() {
+			handler.reset();
+			std::error_code ec;
+			fs::remove_all(options.dir, ec);
+		}
+	};
+
+	int Usage() {
+		std::cout << "usage: ZomboidBench [--files N,...] [--sizes bytes,...] "
+								 "[--ops N] [--io bytes] [--max-bytes N] [--dir path]\n"
+								 "       ZomboidBench replay [--native | --recorded] [--paced] "
+								 "[--dir path] <trace>\n"
+								 "Storage settings are read from the ZOMBOIDDB_* variables "
+								 "like the hook does.\n";
+		return 1;
+	}
+
+	int ReplayMain(const std::vector<std::string_view>& args) {
+		ReplayOptions options;
+		for (size_t i = 1; i < args.size(); ++i) {
+			if (args[i] == "--native")
+				options.native = true;
+			else if (args[i] == "--recorded")
+				options.recorded = true;
+			else if (args[i] == "--paced")
+				options.paced = true;
+			else if (args[i] == "--dir" && i + 1 < args.size())
+				options.dir = fs::path{args[++i]} / "ZomboidBench";
+			else if (options.trace.empty() && !args[i].starts_with("--"))
+				options.trace = args[i];
+			else
+				return Usage();
+		}
+		if (options.trace.empty())
+			return Usage();
+		try {
+			Replay{options}.Run(std::cout);
+		} catch (const std::exception& e) {
+			std::cout << "replay failed: " << e.what() << '\n';
+			return 2;
+		}
+		return 0;
+	}
+} // namespace
+
+int main(int argc, const char* const argv[]) {
+	std::vector<std::string_view> args{argv + 1, argv + argc};
+	sqlite3_initialize();
+	if (!args.empty() && args[0] == "replay")
+		return ReplayMain(args);
+	Options options;
+	for (size_t i = 0; i + 1 < args.size(); i += 2) {
+		if (args[i] == "--files")
+			options.files = ParseList(args[i + 1]);
+		else if (args[i] == "--sizes")
+			options.sizes = ParseList(args[i + 1]);
+		else if (args[i] == "--ops")
+			ParseNumber(args[i + 1], options.ops);
+		else if (args[i] == "--io")
+			ParseNumber(args[i + 1], options.ioSize);
+		else if (args[i] == "--max-bytes")
+			ParseNumber(args[i + 1], options.maxBytes);
+		else if (args[i] == "--dir")
+			options.dir = fs::path{args[i + 1]} / "ZomboidBench";
+		else
+			return Usage();
+	}
+	if (args.size() % 2 != 0 || options.files.empty() ||
+			options.sizes.empty() || options.ops == 0 || options.ioSize == 0)
+		return Usage();
+	Stats::PrintHeader(std::cout);
+	try {
+		for (auto files : options.files)
+			for (auto size : options.sizes) {
+				if (files * size > options.maxBytes)
+					continue;
+				Round{options, files, size}.Run(std::cout);
+			}
+	} catch (const std::exception& e) {
+		std::cout << "benchmark failed: " << e.what() << '\n';
+		return 2;
+	}
+	return 0;
+}
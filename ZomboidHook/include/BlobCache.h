@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ZomboidHook {
+	// Unpacked contents of recently read and written files, shared by every
+	// database in the process and evicted least recently used first once over
+	// budget. Files are keyed by their database and name and split over shards
+	// by hash, each with its own lock and a share of the budget, so threads
+	// reading different files rarely contend.
+	class BlobCache {
+	public:
+		using Contents = std::shared_ptr<const std::vector<uint8_t>>;
+
+	private:
+		static constexpr size_t shardCount = 16;
+
+		struct Key {
+			const void* owner;
+			std::string name;
+
+			bool operator==(const Key&) const = default;
+		};
+		struct KeyHash {
+			size_t operator()(const Key& key) const noexcept;
+		};
+		struct Entry {
+			Key key;
+			Contents data;
+		};
+		struct Shard {
+			std::mutex mutex;
+			std::list<Entry> lru; // Most recently used first.
+			std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> entries;
+			size_t bytes			= 0;
+			uint64_t changes	= 0; // Bumped whenever a file is written or deleted.
+		};
+
+		std::array<Shard, shardCount> shards;
+		std::atomic<size_t> shardBudget = 0;
+
+		Shard& ShardOf(const Key& key) noexcept;
+		// These expect the shard to be locked. Evicting is not a change.
+		void Drop(Shard& shard, const Key& key) noexcept;
+		void Add(Shard& shard, Key&& key, Contents data);
+
+	public:
+		static BlobCache& Instance() noexcept;
+		BlobCache() noexcept = default;
+		BlobCache(const BlobCache&) = delete;
+
+		// Zero turns the cache off and empties it.
+		void SetBudget(size_t bytes);
+		// Whether contents of len bytes would be kept at all.
+		[[nodiscard]] bool Fits(size_t len) const noexcept;
+		// Counts a hit or miss in the metrics.
+		Contents Find(const void* owner, const std::string& name);
+		// A stamp to take before loading name from the database, so that Insert
+		// can tell whether it was changed meanwhile.
+		[[nodiscard]] uint64_t Stamp(const void* owner, const std::string& name);
+		// Keeps contents loaded after stamp unless name changed since.
+		void Insert(const void* owner,
+								const std::string& name,
+								Contents data,
+								uint64_t stamp);
+		// Replaces what is kept for name with contents just written.
+		void Put(const void* owner, const std::string& name, Contents data);
+		void Invalidate(const void* owner, const std::string& name);
+		// Drops every file of owner, as when it is going away or rolled back.
+		void Clear(const void* owner);
+	};
+} // namespace ZomboidHook
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+#include "interface/IFileOps.h"
+
+namespace ZomboidHook {
+	struct ExportProgress {
+		size_t filesDone		= 0;
+		size_t filesSkipped = 0; // Already identical on disk.
+		size_t filesRemoved = 0; // Deleted in the database, so deleted on disk.
+		uint64_t bytesDone	= 0;
+	};
+
+	// Writes every file of a save back out as a plain file, so that the save
+	// can be played without the hook again. Each shard is read front to back by
+	// a thread of its own while a pool of writer threads creates the files, and
+	// files deleted since they were migrated are deleted on disk too. An
+	// incremental export leaves files alone that are already identical.
+	class BulkExporter {
+	public:
+		using ProgressFn = std::function<void(const ExportProgress&)>;
+		struct Options {
+			unsigned writers		 = 4;
+			size_t inFlightBytes = 256 << 20;
+			bool incremental		 = false;
+		};
+
+	private:
+		IFileOps& fileOps;
+		Options options;
+		ProgressFn onProgress;
+
+		// Whether path holds exactly data.
+		bool Identical(const std::filesystem::path& path,
+									 const std::vector<uint8_t>& data);
+
+	public:
+		BulkExporter(IFileOps& fileOps,
+								 Options options,
+								 ProgressFn onProgress = {});
+		ExportProgress Export(const std::filesystem::path& saveDir,
+													const std::filesystem::path& into);
+	};
+} // namespace ZomboidHook
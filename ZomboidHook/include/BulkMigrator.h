@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+#include "Codec.h"
+#include "interface/IFileOps.h"
+
+namespace ZomboidHook {
+	struct MigrationProgress {
+		size_t filesDone	 = 0;
+		size_t filesTotal	 = 0;
+		size_t filesFailed = 0;
+		uint64_t bytesDone = 0;
+	};
+
+	// Imports every .bin file of a save directory up front instead of one at a
+	// time as the game touches them. Reader threads load files while a single
+	// writer per shard inserts them in large, key-ordered transactions, the
+	// writers of a sharded save committing in parallel. Files already in
+	// the database are skipped, so an interrupted run is resumed by running it
+	// again, and data the game wrote since is never overwritten. Hashing and
+	// packing with a codec are done by the reader threads.
+	class BulkMigrator {
+	public:
+		using ProgressFn = std::function<void(const MigrationProgress&)>;
+		struct Options {
+			unsigned readers		 = 4;
+			size_t batchBytes		 = 64 << 20;
+			size_t batchFiles		 = 8192;
+			size_t inFlightBytes = 256 << 20;
+			Codec codec					 = Codec::NONE;
+			uint32_t shards			 = 0; // Zero keeps as many as the save has.
+		};
+
+	private:
+		IFileOps& fileOps;
+		Options options;
+		ProgressFn onProgress;
+
+	public:
+		BulkMigrator(IFileOps& fileOps, Options options, ProgressFn onProgress = {});
+		MigrationProgress Migrate(const std::filesystem::path& saveDir);
+	};
+} // namespace ZomboidHook
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace ZomboidHook {
+	// Packs a chunkdata_X_Y.bin, map_X_Y.bin or zpop_X_Y.bin name into an integer
+	// key: the family in the top bits, then X and Y interleaved bitwise (Z-order)
+	// so that keys of neighbouring chunks are close. Any other name, including
+	// ones that would not be spelled the same way again, yields nullopt.
+	[[nodiscard]] std::optional<int64_t> ChunkKey(std::string_view name) noexcept;
+	// The name a key was made from.
+	[[nodiscard]] std::string ChunkName(int64_t key);
+
+	// Bits per coordinate; the family lies above twice as many.
+	constexpr unsigned chunkCoordBits = 24;
+} // namespace ZomboidHook
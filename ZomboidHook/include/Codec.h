@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ZomboidHook {
+	// How a blob is stored. Written to the database, so values are never reused.
+	enum class Codec
+	{
+		NONE = 0,
+		LZ			 = 1, // LZ4 block format.
+		SEGMENTS = 2, // A list of other blobs making up the file, see SaveDB.
+	};
+
+	// Packs src into out, returning false when that would not save at least an
+	// eighth of its size, in which case the blob is better stored as it is.
+	bool Encode(Codec codec,
+							std::pair<const uint8_t*, size_t> src,
+							std::vector<uint8_t>& out);
+	// Unpacks src into exactly len bytes at dst, throwing if src is corrupt.
+	void Decode(Codec codec,
+							std::pair<const uint8_t*, size_t> src,
+							uint8_t* dst,
+							size_t len);
+} // namespace ZomboidHook
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Codec.h"
+#include "SQLite.h"
+#include "Snapshotter.h"
+
+namespace ZomboidHook {
+	// Which file names are save files. A name must end in one of the extensions
+	// and, unless there are none, start with one of the prefixes.
+	struct InterceptRules {
+		std::vector<std::string> extensions{".bin"};
+		std::vector<std::string> prefixes;
+	};
+
+	// Tunables for the hook. Operators set them through ZOMBOIDDB_* environment
+	// variables; anything unset or unparseable keeps its default.
+	struct Config {
+		CommitPolicy commit;
+		Codec codec = Codec::NONE;
+		InterceptRules intercept;
+		SnapshotPolicy snapshot;
+		size_t cacheMiB = 64; // Budget of the BlobCache, none if zero.
+		uint64_t mmapMiB = 0; // Of each database read through a mapping.
+		bool segmented	 = false;
+		uint32_t shards	 = 1; // Databases each save is spread over.
+		std::filesystem::path trace; // Records every call there when set.
+		std::filesystem::path stats; // Exports the metrics there when set.
+
+		static Config FromEnvironment();
+	};
+} // namespace ZomboidHook
@@ -1,11 +1,11 @@
-#pragma once
-
-#include <ctime>
-
-namespace ZomboidHook {
-	struct FileTimes {
-		time_t creationTime;
-		time_t lastModified;
-		time_t lastAccessed;
-	};
-} // namespace ZomboidHook
+#pragma once
+
+#include <ctime>
+
+namespace ZomboidHook {
+	struct FileTimes {
+		time_t creationTime;
+		time_t lastModified;
+		time_t lastAccessed;
+	};
+} // namespace ZomboidHook
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+namespace ZomboidHook {
+#ifdef _WIN32
+	inline constexpr unsigned handleShift = 2; // Kernel handles are 4 aligned.
+#else
+	inline constexpr unsigned handleShift = 0;
+#endif
+
+	// Maps handle values straight to slots in lazily allocated pages, so telling
+	// whether a handle is ours takes two atomic loads and neither hashes nor
+	// locks. The state kept for our handles is guarded by a lock per slot, so
+	// different handles can be used from different threads at once. Pages are
+	// only freed along with the registry.
+	template <typename T, unsigned shift = handleShift>
+	class HandleRegistry {
+		static constexpr size_t pageSize	= 1024;
+		static constexpr size_t pageCount = 16384;
+
+		struct Slot {
+			std::atomic<bool> used = false;
+			std::mutex mutex;
+			std::optional<T> value;
+		};
+		using Page = std::array<Slot, pageSize>;
+
+		std::array<std::atomic<Page*>, pageCount> pages{};
+		std::atomic<size_t> highWater = 0;
+
+		static std::optional<size_t> Index(int64_t handle) noexcept {
+			if (handle < 0) [[unlikely]]
+				return std::nullopt;
+			auto index = static_cast<size_t>(handle) >> shift;
+			if (index >= capacity) [[unlikely]]
+				return std::nullopt;
+			return index;
+		}
+
+		Slot* FindSlot(int64_t handle) const noexcept {
+			auto index = Index(handle);
+			if (!index) [[unlikely]]
+				return nullptr;
+			auto page = pages[*index / pageSize].load(std::memory_order_acquire);
+			return page ? &(*page)[*index % pageSize] : nullptr;
+		}
+
+		Slot& MakeSlot(int64_t handle) {
+			auto index = Index(handle);
+			if (!index) [[unlikely]]
+				throw std::out_of_range{"Handle outside of the registry"};
+			auto& entry = pages[*index / pageSize];
+			auto page		= entry.load(std::memory_order_acquire);
+			if (!page) {
+				auto fresh = new Page;
+				if (entry.compare_exchange_strong(page, fresh))
+					page = fresh;
+				else
+					delete fresh; // Lost the race, page now holds the winner.
+			}
+			auto high = highWater.load();
+			while (high <= *index &&
+						 !highWater.compare_exchange_weak(high, *index + 1))
+				;
+			return (*page)[*index % pageSize];
+		}
+
+	public:
+		static constexpr size_t capacity = pageSize * pageCount;
+
+		// Keeps the slot of one of our handles locked while it is in use.
+		class Ref {
+			friend class HandleRegistry;
+			Slot* slot = nullptr;
+			std::unique_lock<std::mutex> lock;
+
+			Ref(Slot& slot, std::unique_lock<std::mutex> held) :
+					slot{&slot}, lock{std::move(held)} {
+				if (!slot.used.load(std::memory_order_relaxed)) {
+					lock.unlock();
+					this->slot = nullptr;
+				}
+			}
+
+		public:
+			Ref() noexcept = default;
+
+			explicit operator bool() const noexcept {
+				return slot;
+			}
+
+			T* operator->() const noexcept {
+				return &*slot->value;
+			}
+
+			T& operator*() const noexcept {
+				return *slot->value;
+			}
+
+			// Releases the handle; it is no longer ours once this returns.
+			void Erase() {
+				slot->used.store(false, std::memory_order_release);
+				slot->value.reset();
+				lock.unlock();
+				slot = nullptr;
+			}
+		};
+
+		constexpr HandleRegistry() noexcept = default;
+		HandleRegistry(const HandleRegistry&) = delete;
+
+		[[nodiscard]] bool Contains(int64_t handle) const noexcept {
+			auto slot = FindSlot(handle);
+			return slot && slot->used.load(std::memory_order_acquire);
+		}
+
+		[[nodiscard]] Ref Find(int64_t handle) {
+			auto slot = FindSlot(handle);
+			if (!slot || !slot->used.load(std::memory_order_acquire)) [[likely]]
+				return {};
+			return Ref{*slot, std::unique_lock{slot->mutex}};
+		}
+
+		// Like try_emplace, an existing entry for the handle is left as it is.
+		template <typename... Args>
+		[[nodiscard]] Ref Emplace(int64_t handle, Args&&... args) {
+			auto& slot = MakeSlot(handle);
+			std::unique_lock l{slot.mutex};
+			if (!slot.used.load(std::memory_order_relaxed)) {
+				slot.value.emplace(std::forward<Args>(args)...);
+				slot.used.store(true, std::memory_order_release);
+			}
+			return Ref{slot, std::move(l)};
+		}
+
+		void Erase(int64_t handle) {
+			if (auto ref = Find(handle))
+				ref.Erase();
+		}
+
+		// Visits every entry with its slot locked. Only one slot is locked at a
+		// time, so this must not be called while holding a Ref.
+		template <typename Fn>
+		void ForEach(Fn&& fn) {
+			auto high = highWater.load();
+			for (size_t i = 0; i < high; i += pageSize) {
+				auto page = pages[i / pageSize].load(std::memory_order_acquire);
+				if (!page)
+					continue;
+				for (auto& slot : *page) {
+					if (!slot.used.load(std::memory_order_acquire))
+						continue;
+					std::lock_guard l{slot.mutex};
+					if (slot.used.load(std::memory_order_relaxed))
+						fn(*slot.value);
+				}
+			}
+		}
+
+		~HandleRegistry() {
+			for (auto& page : pages)
+				delete page.load();
+		}
+	};
+} // namespace ZomboidHook
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <shared_mutex>
+
+namespace ZomboidHook {
+	// Shared hold on the mutex that keeps a frontend's handler alive, taken by
+	// the outermost hook on a thread only. The handler's own file calls, such as
+	// SQLite opening its databases, come back through the hooks on the same
+	// thread, and locking a shared_mutex again there is undefined behaviour that
+	// deadlocks once a writer waits.
+	class HandlerLock {
+		static inline thread_local bool held = false;
+		std::shared_lock<std::shared_mutex> lock;
+
+	public:
+		HandlerLock() noexcept = default;
+
+		explicit HandlerLock(std::shared_mutex& mutex) {
+			if (held)
+				return;
+			lock = std::shared_lock{mutex};
+			held = true;
+		}
+
+		HandlerLock(HandlerLock&& rhs) noexcept = default;
+		HandlerLock& operator=(HandlerLock&&) = delete;
+
+		~HandlerLock() {
+			if (lock.owns_lock())
+				held = false;
+		}
+	};
+} // namespace ZomboidHook
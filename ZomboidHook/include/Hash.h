@@ -0,0 +1,23 @@
+#pragma once
+
+#include <array>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace ZomboidHook {
+	// Identifies a blob by its contents. Wide enough that distinct contents
+	// colliding is not a concern, so equal digests are taken as equal data.
+	struct Digest {
+		std::array<uint8_t, 16> bytes{};
+
+		auto operator<=>(const Digest&) const = default;
+		[[nodiscard]] std::pair<const uint8_t*, size_t> Data() const noexcept;
+	};
+
+	// MurmurHash3 x64 128, a few GB/s per core, so hashing on every write costs
+	// far less than the write it may save.
+	[[nodiscard]] Digest HashContent(std::pair<const uint8_t*, size_t> data,
+																	 uint32_t seed = 0) noexcept;
+} // namespace ZomboidHook
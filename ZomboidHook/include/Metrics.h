@@ -0,0 +1,164 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+#include "interface/IFileOps.h"
+
+namespace ZomboidHook {
+	enum class Metric : uint8_t
+	{
+		OPEN_ONLY,
+		CREATE_ONLY,
+		OPEN_OR_CREATE,
+		CREATE_AND_WIPE,
+		OPEN_ONLY_AND_WIPE,
+		READ,
+		WRITE,
+		SEEK,
+		TRUNCATE_TO_CURSOR,
+		TRUNCATE,
+		DELETE,
+		CLOSED,
+		SET_ATTRIB,
+		GET_SIZE,
+		GET_ATTRIB,
+		GET_TIMES,
+		FLUSH,
+		SQL_EXECUTE,
+		SQL_COMMIT,
+		MIGRATE,
+		COUNT,
+	};
+
+	inline constexpr std::array<std::string_view,
+															static_cast<size_t>(Metric::COUNT)>
+			metricNames{
+					"open_only",
+					"create_only",
+					"open_or_create",
+					"create_and_wipe",
+					"open_only_and_wipe",
+					"read",
+					"write",
+					"seek",
+					"truncate_to_cursor",
+					"truncate",
+					"delete",
+					"close",
+					"set_attrib",
+					"get_size",
+					"get_attrib",
+					"get_times",
+					"flush",
+					"sql_execute",
+					"sql_commit",
+					"migrate",
+			};
+
+	static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+	// Latencies in ns on a log-linear scale: exact below 16, then 8 buckets per
+	// power of two, so any value is within 12.5% of its bucket's floor. Record
+	// takes a few relaxed atomic adds and never locks.
+	struct LatencyHistogram {
+		static constexpr size_t subBuckets = 8;
+		static constexpr size_t linear		 = 2 * subBuckets;
+		static constexpr size_t buckets =
+				linear + (64 - std::bit_width(linear - 1)) * subBuckets;
+
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> totalNs;
+		std::atomic<uint64_t> maxNs;
+		std::atomic<uint64_t> bytes;
+		std::array<std::atomic<uint64_t>, buckets> counts;
+
+		static constexpr size_t Bucket(uint64_t ns) noexcept {
+			if (ns < linear)
+				return ns;
+			auto exp = std::bit_width(ns) - 1;
+			auto sub = (ns >> (exp - 3)) & (subBuckets - 1);
+			return linear + (exp - 4) * subBuckets + sub;
+		}
+
+		static constexpr uint64_t Floor(size_t bucket) noexcept {
+			if (bucket < linear)
+				return bucket;
+			auto exp = (bucket - linear) / subBuckets + 4;
+			auto sub = (bucket - linear) % subBuckets;
+			return (subBuckets + sub) << (exp - 3);
+		}
+
+		void Record(uint64_t ns, uint64_t len) noexcept;
+	};
+	static_assert(LatencyHistogram::Bucket(~0ull) ==
+								LatencyHistogram::buckets - 1);
+
+	// Everything counted, laid out to be shared with other processes as is.
+	// Readers check the magic, version and size before trusting the rest.
+	struct MetricsBlock {
+		static constexpr std::array<char, 8> magicValue{
+				'Z', 'D', 'B', 'S', 'T', 'A', 'T', 'S'};
+		static constexpr uint32_t versionValue = 3;
+
+		std::array<char, 8> magic;
+		uint32_t version;
+		uint32_t size;
+		int64_t started; // In seconds since the epoch.
+		std::atomic<uint64_t> bytesRequested; // Written by the game.
+		std::atomic<uint64_t> bytesStored;		// Of blobs written to SQLite.
+		std::atomic<uint64_t> cacheHits;			// In SQLite's page cache.
+		std::atomic<uint64_t> cacheMisses;
+		std::atomic<uint64_t> cacheWrites; // Pages written out by SQLite.
+		std::atomic<uint64_t> blobHits;		 // Reads served by the BlobCache.
+		std::atomic<uint64_t> blobMisses;
+		std::atomic<uint64_t> blobCached; // Bytes held by it right now.
+		std::array<LatencyHistogram, static_cast<size_t>(Metric::COUNT)> ops;
+	};
+
+	// The process wide counters. They are always kept; exporting puts them in
+	// a file mapped by the frontend so that tools can read them live.
+	class Metrics {
+		MetricsBlock local{};
+		std::atomic<MetricsBlock*> block = &local;
+		std::unique_ptr<IMemMappedFile> exported;
+		std::filesystem::path exportPath;
+
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		// Times a call from construction to destruction.
+		class Timer {
+			Metric metric;
+			Clock::time_point start = Clock::now();
+
+		public:
+			uint64_t bytes = 0;
+
+			explicit Timer(Metric metric) noexcept : metric{metric} {}
+			Timer(const Timer&) = delete;
+			~Timer();
+		};
+
+		static Metrics& Instance() noexcept;
+		Metrics() noexcept;
+		Metrics(const Metrics&) = delete;
+		// Moves counting into a shared mapping of path, made by fileOps. Meant to
+		// be called once, before anything counts. Returns whether the file could
+		// be mapped; counting goes on in memory either way.
+		bool Export(IFileOps& fileOps, std::filesystem::path path) noexcept;
+		// Stops exporting and deletes the file.
+		void Close() noexcept;
+		[[nodiscard]] MetricsBlock& Block() noexcept;
+		void Record(Metric metric,
+								Clock::duration duration,
+								uint64_t len = 0) noexcept;
+		~Metrics();
+	};
+} // namespace ZomboidHook
@@ -1,72 +1,100 @@
-#pragma once
-
-#include <string>
-#include <unordered_map>
-
-#include "SQLite.h"
-#include "interface/IFileOps.h"
-#include "interface/IOSCallHandler.h"
-
-namespace ZomboidHook {
-	class SaveDB : public SQLite {
-		size_t getBlobRowIDStmt;
-		size_t blobExistsStmt;
-		size_t upsertBlobStmt;
-		size_t blobSizeStmt;
-		size_t truncateStmt;
-		size_t deleteStmt;
-
-	public:
-		static constexpr const char* table	 = "files";
-		static constexpr const char* dataCol = "data";
-		explicit SaveDB(std::filesystem::path path);
-		size_t GetBlobRowIDStmt() const noexcept;
-		size_t BlobExistsStmt() const noexcept;
-		size_t UpsertBlobStmt() const noexcept;
-		size_t BlobSizeStmt() const noexcept;
-		size_t TruncateStmt() const noexcept;
-		size_t DeleteStmt() const noexcept;
-		void OnClosed() noexcept override;
-	};
-	class OSCallHandler : public IOSCallHandler {
-		std::unordered_map<std::string, SaveDB> databases;
-		std::unordered_map<int64_t, int64_t> filePointers;
-		IFileOps& fileOps;
-
-		static bool BlobExists(SaveDB& db, const std::filesystem::path& path);
-		static bool BlobExists(SaveDB& db, const FileInfo& info);
-		bool ShouldIntercept(const std::filesystem::path& path) noexcept;
-		bool ShouldIntercept(const FileInfo& info) noexcept;
-		SaveDB& GetDBInstance(const std::filesystem::path& path);
-		SaveDB& GetDBInstance(const FileInfo& info);
-
-	public:
-		explicit OSCallHandler(IFileOps& fileOps);
-		[[nodiscard]] FileIntent FileOpenOnly(FileInfo info) override;
-		[[nodiscard]] FileIntent FileCreateOnly(FileInfo info) override;
-		[[nodiscard]] FileIntent FileOpenOrCreate(FileInfo info) override;
-		[[nodiscard]] FileIntent FileCreateAndWipe(FileInfo info) override;
-		[[nodiscard]] FileIntent FileOpenOnlyAndWipe(FileInfo info) override;
-		[[nodiscard]] FileIntent
-				FileRead(FileInfo info, uint8_t* buf, uint32_t& readLen) override;
-		[[nodiscard]] FileIntent FileWrite(FileInfo info,
-																			 const uint8_t* buf,
-																			 uint32_t& writeLen) override;
-		[[nodiscard]] FileIntent
-				FileSeek(FileInfo info, SeekFrom pos, int64_t& distance) override;
-		[[nodiscard]] FileIntent FileTruncateToCursor(FileInfo info) override;
-		[[nodiscard]] FileIntent FileTruncate(FileInfo info, uint64_t len) override;
-		[[nodiscard]] FileIntent
-				FileDelete(const std::filesystem::path& path) override;
-		[[nodiscard]] FileIntent
-				FileSetAttrib(const std::filesystem::path& path) override;
-		[[nodiscard]] FileIntent FileGetSize(FileInfo info,
-																				 uint64_t& sizeOut,
-																				 bool isStateless) override;
-		[[nodiscard]] FileAttribute
-				FileGetAttrib(const std::filesystem::path& path) override;
-		[[nodiscard]] FileTimes
-				FileGetTimes(const std::filesystem::path& path) override;
-		void FileClosed(FileInfo info) override;
-	};
-} // namespace ZomboidHook
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Config.h"
+#include "HandleRegistry.h"
+#include "OpenFile.h"
+#include "PathRouter.h"
+#include "SaveDB.h"
+#include "interface/IFileOps.h"
+#include "interface/IOSCallHandler.h"
+
+namespace ZomboidHook {
+	class OSCallHandler : public IOSCallHandler {
+		PathRouter router; // Outlives openFiles, which refer to its databases.
+		HandleRegistry<OpenFile> openFiles;
+		IFileOps& fileOps;
+		// Handles with writes that are not stored yet, by path, so that a call on
+		// a path only flushes those instead of visiting every open handle.
+		std::mutex dirtyMutex;
+		std::unordered_map<std::filesystem::path::string_type, std::vector<int64_t>>
+				dirtyHandles;
+		// How many handles are listed, so that calls skip the lock and the path
+		// while there are none.
+		std::atomic<size_t> dirtyCount = 0;
+
+		static bool BlobExists(SaveDB& db, const std::filesystem::path& path);
+		static bool BlobExists(SaveDB& db, const FileInfo& info);
+		// Whether a legacy file for path is left on disk to migrate.
+		bool OnDisk(SaveDB& db, const std::filesystem::path& path);
+		bool ShouldIntercept(const std::filesystem::path& path) noexcept;
+		bool ShouldIntercept(const FileInfo& info) noexcept;
+		SaveDB& GetDBInstance(const std::filesystem::path& path);
+		SaveDB& GetDBInstance(const FileInfo& info);
+		HandleRegistry<OpenFile>::Ref GetOpenFile(const FileInfo& info);
+		void Migrate(SaveDB& db, const std::filesystem::path& path);
+		// Lists the handle of info under its path once it holds unstored writes.
+		void MarkDirty(const FileInfo& info);
+		void Unlist(int64_t handle,
+								const std::filesystem::path::string_type& key) noexcept;
+		// Drops the record of info, along with any writes it has not stored.
+		void Forget(const FileInfo& info);
+		// Opens info through fn, forgetting it unless fn succeeds, as the handle
+		// is released then and its number may be handed out again.
+		template <typename Fn>
+		FileIntent Opening(const FileInfo& info, Fn&& fn);
+		// Calls fn with the file of info, which is listed if fn leaves it dirty.
+		template <typename Fn>
+		void Modify(const FileInfo& info, Fn&& fn);
+		void FlushWrites(const std::filesystem::path& path);
+
+	public:
+		explicit OSCallHandler(IFileOps& fileOps, Config config = {});
+		[[nodiscard]] bool MayIntercept(PathView path) const noexcept override;
+		[[nodiscard]] FileIntent FileOpenOnly(FileInfo info) override;
+		[[nodiscard]] FileIntent FileCreateOnly(FileInfo info) override;
+		[[nodiscard]] FileIntent FileOpenOrCreate(FileInfo info) override;
+		[[nodiscard]] FileIntent FileCreateAndWipe(FileInfo info) override;
+		[[nodiscard]] FileIntent FileOpenOnlyAndWipe(FileInfo info) override;
+		[[nodiscard]] FileIntent
+				FileRead(FileInfo info, uint8_t* buf, uint32_t& readLen) override;
+		[[nodiscard]] FileIntent FileWrite(FileInfo info,
+																			 const uint8_t* buf,
+																			 uint32_t& writeLen) override;
+		[[nodiscard]] FileIntent FileReadAt(FileInfo info,
+																				uint8_t* buf,
+																				uint32_t& readLen,
+																				uint64_t offset) override;
+		[[nodiscard]] FileIntent FileWriteAt(FileInfo info,
+																				 const uint8_t* buf,
+																				 uint32_t& writeLen,
+																				 uint64_t offset) override;
+		[[nodiscard]] FileIntent FileAppend(FileInfo info,
+																				const uint8_t* buf,
+																				uint32_t& writeLen) override;
+		[[nodiscard]] FileIntent FileFlush(FileInfo info) override;
+		[[nodiscard]] FileIntent
+				FileSeek(FileInfo info, SeekFrom pos, int64_t& distance) override;
+		[[nodiscard]] FileIntent FileTruncateToCursor(FileInfo info) override;
+		[[nodiscard]] FileIntent FileTruncate(FileInfo info, uint64_t len) override;
+		[[nodiscard]] FileIntent
+				FileDelete(const std::filesystem::path& path) override;
+		[[nodiscard]] FileIntent
+				FileSetAttrib(const std::filesystem::path& path) override;
+		[[nodiscard]] FileIntent FileGetSize(FileInfo info,
+																				 uint64_t& sizeOut,
+																				 bool isStateless) override;
+		[[nodiscard]] FileAttribute
+				FileGetAttrib(const std::filesystem::path& path) override;
+		[[nodiscard]] FileTimes
+				FileGetTimes(const std::filesystem::path& path) override;
+		void FileClosed(FileInfo info) override;
+		~OSCallHandler() override;
+	};
+} // namespace ZomboidHook
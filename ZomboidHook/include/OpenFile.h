@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "SaveDB.h"
+#include "WriteBuffer.h"
+#include "interface/IOSCallHandler.h"
+
+namespace ZomboidHook {
+	// State for one intercepted handle. The row is resolved when the handle is
+	// opened and only looked up again after the database has been modified, so
+	// that a read is a single blob read in the common case, or a copy once the
+	// file is in the BlobCache. Each read leases a
+	// pooled reader for its duration unless this file has changes that are not
+	// yet committed, or reads from memory while they are still queued under
+	// write-behind.
+	class OpenFile {
+		// What one read borrows. The blob is closed before the reader goes back,
+		// so that no snapshot outlives the read.
+		struct Borrowed {
+			SaveDB::ReaderLease reader;
+			std::optional<SQLBlob> blob;
+			SQLSession* blobSession = nullptr;
+			int64_t blobRow					= 0;
+		};
+
+		SaveDB& db;
+		std::filesystem::path path;
+		std::string name;
+		int64_t cursor = 0;
+		std::optional<int64_t> rowID;
+		uint64_t size		= 0;
+		uint64_t seenChanges = 0;
+		Codec codec = Codec::NONE;
+		// All of the contents, once unpacked or while queued.
+		std::shared_ptr<const std::vector<uint8_t>> whole;
+		// Of a segmented file, once read in part, and the last one unpacked.
+		std::vector<Segment> segments;
+		std::vector<uint8_t> unpackedSegment;
+		std::optional<size_t> unpackedIndex;
+		std::optional<WriteBuffer> pending;
+		// Leading segments that pending leaves as stored, up to its base.
+		std::vector<Segment> kept;
+
+		void Resolve();
+		void Refresh();
+		void ReadBlob(uint8_t* buf, uint64_t offset, uint32_t len);
+		void ReadSegments(Borrowed& borrowed,
+											uint8_t* buf,
+											uint64_t offset,
+											uint32_t len);
+		// Reads from the blob at row, reusing the blob borrowed for the read.
+		void ReadRow(Borrowed& borrowed,
+								 int64_t row,
+								 uint8_t* buf,
+								 uint64_t offset,
+								 uint32_t len);
+		// The buffer for writes from offset from on, loading the current contents
+		// if load is set. Of a segmented file, only those from the segment that
+		// from falls in are loaded.
+		WriteBuffer& Buffer(uint64_t from, bool load = true);
+
+	public:
+		OpenFile(SaveDB& db, const std::filesystem::path& path);
+		OpenFile(const OpenFile&) = delete;
+		[[nodiscard]] bool Exists();
+		[[nodiscard]] bool Read(uint8_t* buf, uint32_t& len);
+		void Write(const uint8_t* buf, uint32_t len);
+		// As Read and Write at offset, leaving the cursor where it is.
+		[[nodiscard]] bool ReadAt(uint8_t* buf, uint32_t& len, uint64_t offset);
+		void WriteAt(const uint8_t* buf, uint32_t len, uint64_t offset);
+		// Writes at the end, leaving the cursor after what was written.
+		void Append(const uint8_t* buf, uint32_t len);
+		int64_t Seek(SeekFrom from, int64_t distance);
+		void Truncate(uint64_t len);
+		void TruncateToCursor();
+		void Wipe();
+		void Flush();
+		// Whether there are writes that Flush would store.
+		[[nodiscard]] bool Dirty() const noexcept;
+		[[nodiscard]] uint64_t Size();
+		[[nodiscard]] const std::filesystem::path& Path() const noexcept;
+	};
+} // namespace ZomboidHook
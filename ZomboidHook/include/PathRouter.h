@@ -0,0 +1,52 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+#include "Config.h"
+#include "SaveDB.h"
+#include "Snapshotter.h"
+#include "interface/IFileOps.h"
+#include "interface/IOSCallHandler.h"
+
+namespace ZomboidHook {
+	// Tells save files from everything else and hands out the database each
+	// save file is in, one per save directory unless saves are sharded. Paths
+	// are matched as the OS passed them, so turning away a path that is not a
+	// save file, or routing one of an unsharded save seen before, takes neither
+	// an allocation nor a call to the OS. Only a spelling of a directory not
+	// seen before is normalized, to find the save it may already belong to.
+	class PathRouter {
+		struct SaveDir {
+			std::filesystem::path::string_type dir; // As Key spells it.
+			// Every spelling of dir seen, such as a//b or a/./b for a/b.
+			std::vector<std::filesystem::path::string_type> spellings;
+			std::vector<std::unique_ptr<SaveDB>> shards;
+			std::unique_ptr<Snapshotter> snapshots; // Stops before shards close.
+		};
+
+		IFileOps& fileOps;
+		Config config;
+		mutable std::shared_mutex mutex;
+		std::vector<SaveDir> saves; // Few enough that a linear search is fastest.
+
+		const SaveDir* Find(PathView dir) const noexcept;
+		// The shard of the save a file named name is in.
+		static SaveDB& Route(const SaveDir& save, PathView name);
+
+	public:
+		PathRouter(IFileOps& fileOps, Config config);
+		PathRouter(const PathRouter&) = delete;
+
+		// Checks the file name alone against the intercept rules.
+		[[nodiscard]] bool MatchesName(PathView path) const noexcept;
+		// Also checks that the file lies in Saves/<mode>/<save>/.
+		[[nodiscard]] bool ShouldIntercept(PathView path) const noexcept;
+		// The database the file is in, those of its directory opened on first use.
+		[[nodiscard]] SaveDB& Database(PathView path);
+		// The one spelling of path that every other spelling of it maps to.
+		[[nodiscard]] static std::filesystem::path::string_type Key(PathView path);
+	};
+} // namespace ZomboidHook
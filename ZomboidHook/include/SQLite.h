@@ -1,232 +1,439 @@
-#pragma once
-
-#include <concepts>
-#include <cstdint>
-#include <filesystem>
-#include <mutex>
-#include <optional>
-#include <string_view>
-#include <type_traits>
-#include <vector>
-
-#include "sqlite3.h"
-
-namespace ZomboidHook {
-	template <typename>
-	struct IsCallable : std::false_type {};
-
-	template <typename R, typename... Args>
-	struct IsCallable<R(Args...)> : std::true_type {
-		using return_type = R;
-	};
-
-	template <typename R, typename T, typename... Args>
-	struct IsCallable<R (T::*)(Args...)> : std::true_type {
-		using return_type = R;
-	};
-
-	template <typename R, typename T, typename... Args>
-	struct IsCallable<R (T::*)(Args...) const> : std::true_type {
-		using return_type = R;
-	};
-
-	template <typename T, typename U>
-	inline constexpr bool IsSameOrOptional = (std::same_as<T, U> ||
-																						std::same_as<T, std::optional<U>>);
-
-	template <typename Clbk, typename... Args>
-			requires IsCallable<Clbk>::value ||
-			IsCallable<decltype(&Clbk::operator())>::value struct SQLColFetcher {
-		Clbk&& clbk;
-
-		template <typename T>
-		constexpr auto GetColumn(sqlite3_stmt* stmt, int i) {
-			if constexpr (IsSameOrOptional<T, std::pair<const uint8_t*, size_t>>)
-				return std::pair{
-						static_cast<const uint8_t*>(sqlite3_column_blob(stmt, i)),
-						sqlite3_column_bytes(stmt, i)};
-			else if constexpr (IsSameOrOptional<T, bool>)
-				return sqlite3_column_int(stmt, i) != 0;
-			else if constexpr (IsSameOrOptional<T, int>)
-				return sqlite3_column_int(stmt, i);
-			else if constexpr (IsSameOrOptional<T, int64_t>)
-				return sqlite3_column_int64(stmt, i);
-		}
-
-		explicit constexpr SQLColFetcher(Clbk&& clbk) :
-				clbk{std::forward<Clbk>(clbk)} {}
-		auto operator()(sqlite3_stmt* stmt) {
-			int i = 0;
-			return clbk(GetColumn<Args>(stmt, i++)...);
-		}
-	};
-
-	template <typename>
-	struct RowFetcher;
-	template <typename R, typename... Args>
-	struct RowFetcher<R(Args...)> : SQLColFetcher<R (*)(Args...), Args...> {
-		using SQLColFetcher<R (*)(Args...), Args...>::SQLColFetcher;
-	};
-	template <typename T, typename R, typename... Args>
-	struct RowFetcher<R (T::*)(Args...)> : SQLColFetcher<T, Args...> {
-		using SQLColFetcher<T, Args...>::SQLColFetcher;
-	};
-	template <typename T, typename R, typename... Args>
-	struct RowFetcher<R (T::*)(Args...) const> : SQLColFetcher<T, Args...> {
-		using SQLColFetcher<T, Args...>::SQLColFetcher;
-	};
-
-	template <typename Clbk>
-	RowFetcher(Clbk&&) -> RowFetcher<decltype(&Clbk::operator())>;
-
-	template <typename Clbk>
-	concept is_callable = IsCallable<decltype(&Clbk::operator())>::value;
-	template <typename Clbk>
-	concept is_void_r = std::same_as<
-			typename IsCallable<decltype(&Clbk::operator())>::return_type,
-			void>;
-
-	template <typename>
-	constexpr bool all_params_optional = false;
-	template <typename R, typename... Args>
-	requires(
-			std::same_as<
-					Args,
-					std::optional<
-							typename Args::
-									value_type>>&&...) constexpr bool all_params_optional<R(Args...)> =
-			true;
-
-	struct ZeroBlob {
-		int64_t size;
-	};
-
-	class SQLStatement {
-		sqlite3_stmt* stmt = nullptr;
-		std::mutex mutex;
-
-		constexpr void BindArg(std::string_view arg, int i) {
-			if (SQLITE_OK !=
-					sqlite3_bind_text(stmt, i, arg.data(), arg.size(), nullptr))
-					[[unlikely]]
-				throw std::runtime_error{"Failed to bind"};
-		}
-
-		constexpr void BindArg(std::pair<const uint8_t*, size_t> arg, int i) {
-			if (SQLITE_OK !=
-					sqlite3_bind_blob(stmt, i, arg.first, arg.second, nullptr))
-					[[unlikely]]
-				throw std::runtime_error{"Failed to bind blob"};
-		}
-
-		constexpr void BindArg(int arg, int i) {
-			if (SQLITE_OK != sqlite3_bind_int(stmt, i, arg)) [[unlikely]]
-				throw std::runtime_error{"failed to bind int"};
-		}
-
-		constexpr void BindArg(ZeroBlob blob, int i) {
-			if (SQLITE_OK != sqlite3_bind_zeroblob64(stmt, i, blob.size)) [[unlikely]]
-				throw std::runtime_error{"Failed to bind zeroblob"};
-		}
-
-		class Resetter {
-			sqlite3_stmt* stmt;
-
-		public:
-			explicit Resetter(sqlite3_stmt* stmt) : stmt{stmt} {}
-			~Resetter() {
-				sqlite3_reset(stmt);
-			}
-		};
-
-	public:
-		SQLStatement(sqlite3* db, std::string_view query);
-		SQLStatement(SQLStatement&& rhs) noexcept;
-
-		template <typename Clbk, typename... Args>
-				requires is_callable<Clbk> ||
-				(!is_void_r<Clbk> &&
-				 all_params_optional<Clbk>) auto Execute(Clbk&& clbk, Args&&... args) {
-			auto i = 1;
-			std::lock_guard l{mutex};
-			Resetter r{stmt};
-			(BindArg(std::forward<Args>(args), i++), ...);
-			switch (sqlite3_step(stmt)) {
-				case SQLITE_ROW:
-					return RowFetcher{std::forward<Clbk>(clbk)}(stmt);
-					break;
-				case SQLITE_DONE:
-					if constexpr (!is_void_r<Clbk>)
-						throw std::logic_error{
-								"void callback issued SQL query with no result"};
-					break;
-				default:
-					throw std::runtime_error{"Failed exec: "};
-			}
-		}
-
-		template <typename... Args>
-		auto Execute(Args&&... args) {
-			return Execute([]() {}, std::forward<Args>(args)...);
-		}
-		~SQLStatement();
-	};
-
-	class SQLConn {
-		sqlite3* db = nullptr;
-
-	public:
-		explicit SQLConn(const std::filesystem::path& path);
-		SQLConn(SQLConn&& rhs) noexcept;
-		operator sqlite3*() const noexcept;
-		~SQLConn();
-	};
-
-	template <typename T>
-	requires std::invocable<decltype(&T::OnClosed), T&> class OnClosed {
-		T& onClosed;
-
-	public:
-		explicit OnClosed(T& clbk) noexcept : onClosed{clbk} {}
-		~OnClosed() {
-			onClosed.OnClosed();
-		}
-	};
-
-	class SQLBlob;
-	class SQLite {
-		virtual void OnClosed() noexcept = 0;
-		friend class ::ZomboidHook::OnClosed<SQLite>;
-		friend class ::ZomboidHook::SQLBlob;
-
-		ZomboidHook::OnClosed<SQLite> onClosed{*this}; // do not reorder,
-		SQLConn conn;
-		std::filesystem::path path;
-		std::vector<SQLStatement> statements;
-
-		operator sqlite3*() noexcept;
-
-	public:
-		explicit SQLite(std::filesystem::path path, std::string_view schema = "");
-		size_t PrepareStatement(std::string_view query);
-		void Execute(std::string_view query);
-		[[nodiscard]] const std::filesystem::path& Path() const noexcept;
-		[[nodiscard]] sqlite3_int64 LastInsertRowID() const noexcept;
-		[[nodiscard]] int RowsChanged() const noexcept;
-		SQLStatement& operator[](size_t idx) noexcept;
-	};
-
-	class SQLBlob {
-		sqlite3_blob* blob = nullptr;
-
-	public:
-		SQLBlob(SQLite& db, const char* table, const char* col, sqlite3_int64 row);
-		SQLBlob(const SQLite&) = delete;
-		SQLBlob(SQLite&&)			 = delete;
-		void Read(uint8_t* buf, size_t offset, size_t len) const;
-		void Write(std::pair<const uint8_t*, size_t>, size_t offset);
-		void Reopen(sqlite3_int64 rowID);
-		[[nodiscard]] size_t Size() const noexcept;
-		~SQLBlob();
-	};
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Metrics.h"
+#include "sqlite3.h"
+
+namespace ZomboidHook {
+	template <typename>
+	struct IsCallable : std::false_type {};
+
+	template <typename R, typename... Args>
+	struct IsCallable<R(Args...)> : std::true_type {
+		using return_type = R;
+	};
+
+	template <typename R, typename T, typename... Args>
+	struct IsCallable<R (T::*)(Args...)> : std::true_type {
+		using return_type = R;
+	};
+
+	template <typename R, typename T, typename... Args>
+	struct IsCallable<R (T::*)(Args...) const> : std::true_type {
+		using return_type = R;
+	};
+
+	template <typename T, typename U>
+	inline constexpr bool IsSameOrOptional = (std::same_as<T, U> ||
+																						std::same_as<T, std::optional<U>>);
+
+	template <typename Clbk, typename... Args>
+			requires IsCallable<Clbk>::value ||
+			IsCallable<decltype(&Clbk::operator())>::value struct SQLColFetcher {
+		Clbk&& clbk;
+
+		template <typename T>
+		constexpr auto GetColumn(sqlite3_stmt* stmt, int i) {
+			if constexpr (IsSameOrOptional<T, std::pair<const uint8_t*, size_t>>)
+				return std::pair{
+						static_cast<const uint8_t*>(sqlite3_column_blob(stmt, i)),
+						sqlite3_column_bytes(stmt, i)};
+			else if constexpr (IsSameOrOptional<T, std::string_view>)
+				return std::string_view{
+						reinterpret_cast<const char*>(sqlite3_column_text(stmt, i)),
+						static_cast<size_t>(sqlite3_column_bytes(stmt, i))};
+			else if constexpr (IsSameOrOptional<T, bool>)
+				return sqlite3_column_int(stmt, i) != 0;
+			else if constexpr (IsSameOrOptional<T, int>)
+				return sqlite3_column_int(stmt, i);
+			else if constexpr (IsSameOrOptional<T, int64_t>)
+				return sqlite3_column_int64(stmt, i);
+		}
+
+		explicit constexpr SQLColFetcher(Clbk&& clbk) :
+				clbk{std::forward<Clbk>(clbk)} {}
+		auto operator()(sqlite3_stmt* stmt) {
+			// Argument evaluation order is unspecified, so index columns explicitly.
+			return [&]<size_t... I>(std::index_sequence<I...>) {
+				return clbk(GetColumn<Args>(stmt, I)...);
+			}(std::index_sequence_for<Args...>{});
+		}
+	};
+
+	template <typename>
+	struct RowFetcher;
+	template <typename R, typename... Args>
+	struct RowFetcher<R(Args...)> : SQLColFetcher<R (*)(Args...), Args...> {
+		using SQLColFetcher<R (*)(Args...), Args...>::SQLColFetcher;
+	};
+	template <typename T, typename R, typename... Args>
+	struct RowFetcher<R (T::*)(Args...)> : SQLColFetcher<T, Args...> {
+		using SQLColFetcher<T, Args...>::SQLColFetcher;
+	};
+	template <typename T, typename R, typename... Args>
+	struct RowFetcher<R (T::*)(Args...) const> : SQLColFetcher<const T, Args...> {
+		using SQLColFetcher<const T, Args...>::SQLColFetcher;
+	};
+
+	template <typename Clbk>
+	RowFetcher(Clbk&&) -> RowFetcher<decltype(&Clbk::operator())>;
+
+	template <typename Clbk>
+	concept is_callable = IsCallable<decltype(&Clbk::operator())>::value;
+	template <typename Clbk>
+	concept is_void_r = std::same_as<
+			typename IsCallable<decltype(&Clbk::operator())>::return_type,
+			void>;
+
+	template <typename>
+	constexpr bool all_params_optional = false;
+	template <typename R, typename... Args>
+	requires(
+			std::same_as<
+					Args,
+					std::optional<
+							typename Args::
+									value_type>>&&...) constexpr bool all_params_optional<R(Args...)> =
+			true;
+
+	struct ZeroBlob {
+		int64_t size;
+	};
+
+	// Steps through the rows of a query one at a time, keeping its statement
+	// locked until destroyed, for callers that stop early or interleave the
+	// rows with other work.
+	class SQLCursor {
+		sqlite3_stmt* stmt;
+		std::unique_lock<std::mutex> lock;
+
+	public:
+		SQLCursor(sqlite3_stmt* stmt, std::mutex& mutex) :
+				stmt{stmt}, lock{mutex} {}
+		SQLCursor(SQLCursor&& rhs) noexcept :
+				stmt{std::exchange(rhs.stmt, nullptr)}, lock{std::move(rhs.lock)} {}
+
+		// Calls clbk with the columns of the next row, or returns false once
+		// there are none left. Takes clbk by reference only, so that it can be
+		// called again for the rows after.
+		template <typename Clbk>
+				requires is_callable<std::remove_cvref_t<Clbk>> &&
+				is_void_r<std::remove_cvref_t<Clbk>>
+		bool Next(Clbk&& clbk) {
+			using Fn = std::remove_cvref_t<Clbk>;
+			switch (sqlite3_step(stmt)) {
+				case SQLITE_ROW:
+					RowFetcher<decltype(&Fn::operator())>{std::move(clbk)}(stmt);
+					return true;
+				case SQLITE_DONE:
+					return false;
+				default:
+					throw std::runtime_error{"Failed exec: "};
+			}
+		}
+
+		~SQLCursor() {
+			if (stmt)
+				sqlite3_reset(stmt);
+		}
+	};
+
+	class SQLStatement {
+		sqlite3_stmt* stmt = nullptr;
+		std::mutex mutex;
+
+		void BindArg(std::string_view arg, int i) {
+			if (SQLITE_OK !=
+					sqlite3_bind_text(stmt, i, arg.data(), arg.size(), nullptr))
+					[[unlikely]]
+				throw std::runtime_error{"Failed to bind"};
+		}
+
+		void BindArg(std::pair<const uint8_t*, size_t> arg, int i) {
+			if (SQLITE_OK !=
+					sqlite3_bind_blob(stmt, i, arg.first, arg.second, nullptr))
+					[[unlikely]]
+				throw std::runtime_error{"Failed to bind blob"};
+		}
+
+		void BindArg(int arg, int i) {
+			if (SQLITE_OK != sqlite3_bind_int(stmt, i, arg)) [[unlikely]]
+				throw std::runtime_error{"failed to bind int"};
+		}
+
+		void BindArg(int64_t arg, int i) {
+			if (SQLITE_OK != sqlite3_bind_int64(stmt, i, arg)) [[unlikely]]
+				throw std::runtime_error{"failed to bind int64"};
+		}
+
+		void BindArg(ZeroBlob blob, int i) {
+			if (SQLITE_OK != sqlite3_bind_zeroblob64(stmt, i, blob.size)) [[unlikely]]
+				throw std::runtime_error{"Failed to bind zeroblob"};
+		}
+
+		class Resetter {
+			sqlite3_stmt* stmt;
+
+		public:
+			explicit Resetter(sqlite3_stmt* stmt) : stmt{stmt} {}
+			~Resetter() {
+				sqlite3_reset(stmt);
+			}
+		};
+
+	public:
+		SQLStatement(sqlite3* db, std::string_view query);
+		SQLStatement(SQLStatement&& rhs) noexcept;
+
+		template <typename Clbk, typename... Args>
+				requires is_callable<Clbk> ||
+				(!is_void_r<Clbk> &&
+				 all_params_optional<Clbk>) auto Execute(Clbk&& clbk, Args&&... args) {
+			Metrics::Timer timer{Metric::SQL_EXECUTE};
+			auto i = 1;
+			std::lock_guard l{mutex};
+			Resetter r{stmt};
+			(BindArg(std::forward<Args>(args), i++), ...);
+			switch (sqlite3_step(stmt)) {
+				case SQLITE_ROW:
+					return RowFetcher{std::forward<Clbk>(clbk)}(stmt);
+					break;
+				case SQLITE_DONE:
+					if constexpr (!is_void_r<Clbk>)
+						throw std::logic_error{
+								"void callback issued SQL query with no result"};
+					break;
+				default:
+					throw std::runtime_error{"Failed exec: "};
+			}
+		}
+
+		template <typename... Args>
+		auto Execute(Args&&... args) {
+			return Execute([]() {}, std::forward<Args>(args)...);
+		}
+
+		// Binds args and returns a cursor over the rows of the result.
+		template <typename... Args>
+		[[nodiscard]] SQLCursor Query(Args&&... args) {
+			SQLCursor cursor{stmt, mutex};
+			auto i = 1;
+			(BindArg(std::forward<Args>(args), i++), ...);
+			return cursor;
+		}
+
+		// Steps through every row of the result, calling clbk for each.
+		template <typename Clbk, typename... Args>
+				requires is_callable<std::remove_cvref_t<Clbk>> &&
+				is_void_r<std::remove_cvref_t<Clbk>>
+		void ForEach(Clbk&& clbk, Args&&... args) {
+			auto cursor = Query(std::forward<Args>(args)...);
+			while (cursor.Next(clbk)) {}
+		}
+
+		// Runs the statement once for each of rows, bound to the tuple of
+		// arguments bind returns for it, under one lock. Returns how many rows
+		// were changed in total.
+		template <typename Rows, typename Bind>
+		int64_t ExecuteBatch(const Rows& rows, Bind&& bind) {
+			Metrics::Timer timer{Metric::SQL_EXECUTE};
+			std::lock_guard l{mutex};
+			int64_t changed = 0;
+			for (auto& row : rows) {
+				Resetter r{stmt};
+				std::apply(
+						[&](auto&&... args) {
+							auto i = 1;
+							(BindArg(std::forward<decltype(args)>(args), i++), ...);
+						},
+						bind(row));
+				auto result = sqlite3_step(stmt);
+				while (result == SQLITE_ROW)
+					result = sqlite3_step(stmt);
+				if (result != SQLITE_DONE) [[unlikely]]
+					throw std::runtime_error{"Failed exec: "};
+				changed += sqlite3_changes(sqlite3_db_handle(stmt));
+			}
+			return changed;
+		}
+		~SQLStatement();
+	};
+
+	class SQLConn {
+		sqlite3* db = nullptr;
+
+	public:
+		explicit SQLConn(const std::filesystem::path& path,
+										 int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+		SQLConn(SQLConn&& rhs) noexcept;
+		operator sqlite3*() const noexcept;
+		void Close() noexcept;
+		~SQLConn();
+	};
+
+	enum class Durability
+	{
+		OFF,		// Grouped commits, never synced to disk.
+		GROUP,	// Grouped commits, synced at WAL checkpoints.
+		PER_OP, // Every mutation commits on its own.
+		FULL,		// Every mutation commits and is synced to disk.
+	};
+
+	// When grouping, mutations share one explicit transaction that commits once
+	// it is window old, holds maxOps mutations or has seen no mutation for
+	// idleGap, bounding what a crash can lose.
+	struct CommitPolicy {
+		Durability durability = Durability::GROUP;
+		std::chrono::milliseconds window{1000};
+		uint32_t maxOps = 4096;
+		std::chrono::milliseconds idleGap{100};
+		// Stores and deletes are queued for a writer thread of their own, and
+		// only count as a mutation under the durability above once applied.
+		bool writeBehind = false;
+		// Free pages are handed back to the file system a few at a time once
+		// writes pause for idleGap with at least this many of them, rather than
+		// compacting the whole database on close. Zero leaves them be.
+		uint32_t vacuumPages = 2048;
+
+		[[nodiscard]] bool Grouped() const noexcept;
+	};
+
+	class SQLBlob;
+	// A connection along with the statements prepared on it.
+	class SQLSession {
+		friend class ::ZomboidHook::SQLBlob;
+
+	protected:
+		SQLConn conn;
+		std::vector<SQLStatement> statements;
+
+		operator sqlite3*() noexcept;
+
+	public:
+		using ScalarFn = void (*)(sqlite3_context*, int, sqlite3_value**);
+
+		explicit SQLSession(const std::filesystem::path& path,
+												int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+		SQLSession(const SQLSession&) = delete;
+		size_t PrepareStatement(std::string_view query);
+		// Returns whether every statement in query succeeded.
+		bool Execute(std::string_view query);
+		// Makes a deterministic SQL function of argCount arguments available.
+		void CreateFunction(const char* name, int argCount, ScalarFn fn);
+		SQLStatement& operator[](size_t idx) noexcept;
+	};
+
+	class SQLite : public SQLSession {
+		std::filesystem::path path;
+		CommitPolicy policy;
+		std::atomic<uint64_t> commits = 0;
+		std::mutex txnMutex;
+		std::atomic<std::thread::id> mutator; // Whichever thread holds txnMutex.
+		std::condition_variable_any txnCondVar;
+		bool inTxn			= false;
+		uint32_t txnOps = 0;
+		std::chrono::steady_clock::time_point txnStart;
+		std::chrono::steady_clock::time_point lastOp;
+		bool vacuums			 = false; // Whether the database was made incremental.
+		bool vacuumPending = false; // Whether pages may have been freed since.
+		std::jthread committer; // do not reorder, must stop before the above.
+
+		void CommitLocked();
+		void CommitLoop(std::stop_token stop);
+		// Expects txnMutex held through l, which is let go between steps.
+		void VacuumLocked(std::unique_lock<std::mutex>& l, std::stop_token& stop);
+		// Adds the page cache figures since the last call to the metrics.
+		void CountCache() noexcept;
+
+	protected:
+		// Commits and closes the connection early, for derived classes that need
+		// to act once the database file has been released.
+		void Close() noexcept;
+		// Whether the calling thread holds a mutation.
+		[[nodiscard]] bool Mutating() const noexcept;
+		// Called with the mutation still held as the outermost one ends, telling
+		// whether what it changed is kept: once committed when it is a
+		// transaction of its own, and not if that was rolled back instead.
+		virtual void Mutated(bool) noexcept {}
+		// Called with the mutation lock held once a failed group commit rolled
+		// back every mutation since the last commit.
+		virtual void RolledBack() {}
+
+	public:
+		// Held while a statement modifies the database so that it lands in the
+		// current group transaction and is never split by a commit. Without
+		// grouping it is a transaction of its own, unless one is open already.
+		// Nested on the thread holding one, it does nothing.
+		class Mutation {
+			SQLite& db;
+			bool nested;
+			std::unique_lock<std::mutex> lock;
+			bool own = false;
+			int exceptions = std::uncaught_exceptions();
+
+		public:
+			explicit Mutation(SQLite& db);
+			Mutation(const Mutation&) = delete;
+			// Commits a transaction of its own, throwing if that fails, or rolls it
+			// back when left by an exception.
+			~Mutation() noexcept(false);
+		};
+
+		explicit SQLite(std::filesystem::path path,
+										std::string_view schema = "",
+										CommitPolicy policy = {});
+		SQLite(const SQLite&) = delete;
+		[[nodiscard]] Mutation Mutate();
+		// As SQLStatement::ExecuteBatch on statement idx, as one mutation so that
+		// the rows are never committed one at a time.
+		template <typename Rows, typename Bind>
+		int64_t ExecuteBatch(size_t idx, const Rows& rows, Bind&& bind) {
+			Mutation mutation{*this};
+			return statements[idx].ExecuteBatch(rows, std::forward<Bind>(bind));
+		}
+		// Throws when the commit fails, with the group left open if SQLite kept it.
+		void Commit();
+		[[nodiscard]] const CommitPolicy& Policy() const noexcept;
+		// Counts group commits, telling when pending changes became visible.
+		[[nodiscard]] uint64_t Commits() const noexcept;
+		[[nodiscard]] const std::filesystem::path& Path() const noexcept;
+		[[nodiscard]] sqlite3_int64 LastInsertRowID() const noexcept;
+		[[nodiscard]] int RowsChanged() const noexcept;
+		[[nodiscard]] int TotalChanges() const noexcept;
+		~SQLite();
+	};
+
+	class SQLBlob {
+		sqlite3_blob* blob = nullptr;
+
+	public:
+		SQLBlob(SQLSession& db,
+						const char* table,
+						const char* col,
+						sqlite3_int64 row,
+						bool writable = true);
+		SQLBlob(const SQLBlob&) = delete;
+		SQLBlob(SQLBlob&&)			= delete;
+		void Read(uint8_t* buf, size_t offset, size_t len) const;
+		void Write(std::pair<const uint8_t*, size_t>, size_t offset);
+		void Reopen(sqlite3_int64 rowID);
+		[[nodiscard]] size_t Size() const noexcept;
+		~SQLBlob();
+	};
 } // namespace ZomboidHook
\ No newline at end of file
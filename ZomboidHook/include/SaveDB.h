@@ -0,0 +1,316 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ChunkKey.h"
+#include "Codec.h"
+#include "Hash.h"
+#include "SQLite.h"
+
+namespace ZomboidHook {
+	struct BlobStat {
+		std::optional<int64_t> rowID; // Of the blob, none if there is no file.
+		uint64_t size = 0;
+		Codec codec		= Codec::NONE;
+	};
+
+	struct Segment {
+		Digest digest;
+		int64_t rowID		= 0;
+		uint64_t offset = 0; // Within the file.
+		uint64_t size		= 0; // Unpacked.
+		Codec codec			= Codec::NONE;
+	};
+
+	// How a SaveDB stores what is written to it.
+	struct StorageOptions {
+		Codec codec				= Codec::NONE;
+		uint64_t mmapSize = 0; // Of the database to read through a mapping.
+		// Files larger than a segment are stored as segments, so that rewriting
+		// part of one only stores the segments that changed.
+		bool segmented = false;
+		// Of the save this database is a shard of, see Shards.h.
+		uint32_t shards = 1;
+	};
+
+	// Files map names to the digest of their contents, and each distinct content
+	// is stored once in blobs along with how many files refer to it. Chunk files
+	// are kept in chunks under their ChunkKey, so that neighbours share pages and
+	// lookups compare integers; any other file is kept in entries by name.
+	// A segmented file is a manifest blob listing the digests of its segments,
+	// which are blobs of their own counting one reference per listing.
+	class SaveDB : public SQLite {
+		using Contents = std::shared_ptr<const std::vector<uint8_t>>;
+
+		// The newest store or delete of a file waiting for the writer thread.
+		struct QueuedFile {
+			Contents data; // Empty for a delete, which reads as an empty file.
+			bool remove		= false;
+			bool inQueue	= false;
+			bool failed		= false; // Kept to be read and retried on close.
+			uint64_t seq	= 0;
+		};
+
+		// Statements that look a file up come in pairs: by name from entries,
+		// then by key from chunks, followed by those looking a blob up by digest.
+		// These are prepared first and in this order on the writer as well as the
+		// readers, so the same index selects them on either connection. Sizes are
+		// those of the unpacked blobs.
+		static constexpr std::array<const char*, 4> readQueries{
+				"SELECT blobs.data, blobs.codec, blobs.size FROM entries "
+				"LEFT JOIN blobs ON blobs.hash = entries.hash WHERE entries.name = ?1",
+				"SELECT blobs.data, blobs.codec, blobs.size FROM chunks "
+				"LEFT JOIN blobs ON blobs.hash = chunks.hash WHERE chunks.key = ?1",
+				"SELECT data, codec, size FROM blobs WHERE hash = ?1",
+				"SELECT rowid, size, codec FROM blobs WHERE hash = ?1"};
+		// Readers open at once; a read finding them all leased waits for one.
+		static constexpr size_t maxReaders = 8;
+
+		size_t getBlobStmt;
+		size_t getSegmentStmt;
+		size_t statBlobStmt;
+		size_t getHashStmt;
+		size_t upsertEntryStmt;
+		size_t deleteStmt;
+		size_t refBlobStmt;
+		size_t unrefBlobStmt;
+		size_t dropBlobStmt;
+		size_t insertBlobStmt;
+		size_t droppedManifestStmt;
+		StorageOptions options;
+		std::string mmapPragma; // Run on every connection, empty for none.
+		std::vector<uint8_t> packed; // Guarded by the mutation.
+
+		std::mutex readersMutex;
+		std::condition_variable readersCondVar;
+		std::vector<std::unique_ptr<SQLSession>> idleReaders;
+		size_t openReaders = 0;
+		// Files changed in the group transaction that is still open, which the
+		// readers cannot see yet.
+		std::mutex dirtyMutex;
+		std::unordered_set<std::string> dirty;
+		uint64_t dirtyCommits = 0;
+		// Every file in the database as the writer sees it, loaded on open and
+		// updated as each mutation ends, once committed if it is a transaction of
+		// its own. Entries without a row ID are files known to be missing from
+		// disk as well.
+		mutable std::shared_mutex indexMutex;
+		std::unordered_map<int64_t, BlobStat> chunkIndex;
+		std::unordered_map<std::string, BlobStat> nameIndex;
+		std::atomic<uint64_t> indexChanges = 0;
+		// What the current mutation has yet to publish to the index and the
+		// BlobCache, guarded by it.
+		std::vector<std::pair<std::string, BlobStat>> unindexed;
+		std::vector<std::pair<std::string, Contents>> uncached;
+		// Write-behind: files stored or deleted that the writer has yet to apply,
+		// which are read from here until it has.
+		mutable std::mutex queueMutex;
+		std::condition_variable_any queueCondVar;
+		std::unordered_map<std::string, QueuedFile> queued;
+		std::deque<std::string> queue;
+		std::atomic<size_t> queuedFiles = 0;
+		std::atomic<uint64_t> queueChanges = 0;
+		uint64_t queueSeq = 0;
+		bool applying = false;
+		std::jthread writer; // Stopped by the destructor before closing.
+
+		std::unique_ptr<SQLSession> TakeReader();
+		void ReturnReader(std::unique_ptr<SQLSession> reader) noexcept;
+		bool IsDirty(const std::string& name);
+		// Records that name is changed by the current mutation.
+		void MarkDirty(const std::string& name);
+		void UpgradeSchema();
+		// Replaces the index with what the database holds, keeping the files
+		// known to be missing.
+		void LoadIndex();
+		// Records the shard count in a database that has no files yet, or throws
+		// if it was stored with another.
+		void CheckShards();
+		// Looks name up in the index, whose lock the caller holds.
+		const BlobStat* Find(const std::string& name) const;
+		// Replaces what the index holds for name unless only adding.
+		void Index(const std::string& name, BlobStat stat, bool onlyAdd = false);
+		// As Index and BlobCache::Put, once the current mutation if any is done.
+		void StageIndex(const std::string& name, BlobStat stat);
+		void StageCache(const std::string& name, Contents data);
+		size_t PreparePair(std::string_view byName, std::string_view byKey);
+		// Runs the statement pair at stmt for the file name, binding its key
+		// first and args after it.
+		template <typename Clbk, typename... Args>
+		auto ExecuteFor(SQLSession& session,
+										size_t stmt,
+										const std::string& name,
+										Clbk&& clbk,
+										Args&&... args) {
+			if (auto key = ChunkKey(name))
+				return session[stmt + 1].Execute(
+						std::forward<Clbk>(clbk), *key, std::forward<Args>(args)...);
+			return session[stmt].Execute(std::forward<Clbk>(clbk),
+																	 std::string_view{name},
+																	 std::forward<Args>(args)...);
+		}
+		// Unpacks a stored blob of len bytes into buf, reading the segments it
+		// lists through session if it is a manifest.
+		void Unpack(SQLSession& session,
+								std::pair<const uint8_t*, size_t> stored,
+								Codec codec,
+								uint8_t* buf,
+								size_t len);
+		void ReadSegments(SQLSession& session,
+											std::pair<const uint8_t*, size_t> manifest,
+											uint64_t offset,
+											size_t len,
+											uint8_t* buf);
+		std::optional<Digest> GetHash(const std::string& name);
+		// Adds a reference to the blob with digest, false if it is not stored.
+		bool Ref(const Digest& digest);
+		// Points name at the blob with digest, returning false if that blob is
+		// not stored yet and has to be inserted with a first reference.
+		bool Link(const std::string& name, const Digest& digest);
+		void Unref(const Digest& digest);
+		// Inserts a blob with a first reference, returning its row ID.
+		int64_t InsertData(const Digest& digest,
+											 std::pair<const uint8_t*, size_t> stored,
+											 Codec codec,
+											 size_t size);
+		void InsertBlob(const std::string& name,
+										const Digest& digest,
+										std::pair<const uint8_t*, size_t> stored,
+										Codec codec,
+										size_t size);
+		// Stores a segmented file made of the kept segments, which must still be
+		// stored, followed by data.
+		void PutSegments(const std::string& name,
+										 const std::vector<Segment>& kept,
+										 std::pair<const uint8_t*, size_t> data);
+		void Enqueue(const std::string& name, Contents data, bool remove);
+		// Applies everything queued in one mutation, with l held on entry and
+		// released meanwhile.
+		void ApplyQueued(std::unique_lock<std::mutex>& l);
+		void WriteBehind(std::stop_token stop);
+
+	protected:
+		void Mutated(bool kept) noexcept override;
+		void RolledBack() override;
+
+	public:
+		static constexpr const char* fileName = "ZomboidSQLite.db";
+		static constexpr const char* table		= "blobs";
+		static constexpr const char* dataCol	= "data";
+		static constexpr uint32_t segmentSize = 64 << 10;
+
+		// A read-only connection borrowed from the pool until dropped. Leases are
+		// meant to last one read, as a reader keeps the pool's cap taken.
+		class ReaderLease {
+			friend class SaveDB;
+			SaveDB* db = nullptr;
+			std::unique_ptr<SQLSession> reader;
+
+		public:
+			ReaderLease() noexcept = default;
+			ReaderLease(ReaderLease&& rhs) noexcept = default;
+			ReaderLease& operator=(ReaderLease&&) = delete;
+			~ReaderLease();
+		};
+
+		SaveDB(std::filesystem::path path,
+					 CommitPolicy policy,
+					 StorageOptions options = {});
+		// The connection to read name through: the writer while it holds
+		// uncommitted changes to it, otherwise a reader leased into lease.
+		SQLSession& ReadSession(const std::string& name, ReaderLease& lease);
+		// Counts changes to the index and to the queue, telling when what a file
+		// reads back may have changed.
+		[[nodiscard]] uint64_t Changes() const noexcept;
+		// The contents queued for name, if there are any yet to be applied.
+		Contents Queued(const std::string& name) const;
+		// These answer from the index and the queue and never query the database.
+		BlobStat Stat(const std::string& name) const;
+		bool Exists(const std::string& name) const;
+		uint64_t Size(const std::string& name) const;
+		// Whether name is known to be missing from the legacy files on disk too.
+		bool KnownMissing(const std::string& name) const;
+		// Records that name has neither a row nor a file on disk. Save files only
+		// ever appear on disk through the game, whose writes end up here instead,
+		// so this holds until name is stored.
+		void MarkMissing(const std::string& name);
+		// Reads the unpacked contents of name into out, false if there is no file.
+		// Contents still queued are copied from the queue.
+		bool LoadBlob(const std::string& name,
+									ReaderLease& lease,
+									std::vector<uint8_t>& out);
+		// All of the unpacked contents of name, from the queue, the BlobCache or
+		// else the database, after which they are cached. Null if there is no
+		// file.
+		Contents LoadWhole(const std::string& name, ReaderLease& lease);
+		// Reads all of name straight into buf, unpacking it there if need be,
+		// when it holds exactly len bytes. Returns false otherwise.
+		bool ReadWhole(const std::string& name,
+									 ReaderLease& lease,
+									 uint8_t* buf,
+									 size_t len);
+		// Where each segment of a segmented file is stored, so that reading part
+		// of it only touches the segments in range. Empty if name is no such file.
+		std::vector<Segment> Segments(const std::string& name, ReaderLease& lease);
+		// Calls fn with the name and unpacked contents of every file stored, or
+		// with none for deleted ones. Blobs are read in the order they were
+		// inserted, which is mostly the order they lie in the database.
+		void ForEachFile(const std::function<void(
+												 const std::string& name,
+												 std::optional<std::vector<uint8_t>> data)>& fn);
+		// Reads the unpacked contents of a segment of name into out.
+		void LoadSegment(const std::string& name,
+										 const Segment& segment,
+										 ReaderLease& lease,
+										 std::vector<uint8_t>& out);
+		// These modify the database and must be called within a mutation or a
+		// transaction of the caller's.
+		// Stores data under name. Contents already stored only gain a reference,
+		// new ones are packed with the configured codec if it pays off, and so
+		// are the new segments of a segmented file.
+		void PutBlob(const std::string& name,
+								 std::pair<const uint8_t*, size_t> data);
+		// As above for data the caller already hashed and packed with codec, size
+		// bytes once unpacked.
+		void PutBlob(const std::string& name,
+								 const Digest& digest,
+								 std::pair<const uint8_t*, size_t> stored,
+								 Codec codec,
+								 size_t size);
+		// Leaves a tombstone for name, returning whether it had a row.
+		bool DeleteBlob(const std::string& name);
+		// Store and Remove change a whole file as a mutation of their own, right
+		// away or through the writer thread under write-behind. Store moves data
+		// into the queue, and otherwise leaves it as it was.
+		void Store(const std::string& name, std::vector<uint8_t>& data);
+		// Stores a segmented file that keeps the leading segments it has, with
+		// data after them, so that only the segments from there on are hashed
+		// and stored. Always right away, for use without write-behind only.
+		void Store(const std::string& name,
+							 const std::vector<Segment>& kept,
+							 std::vector<uint8_t>& data);
+		// Returns whether name had a row, as DeleteBlob does.
+		bool Remove(const std::string& name);
+		// Waits until everything queued so far has been applied.
+		void Drain();
+		// Whether every blob of a copy of a save database, such as a snapshot,
+		// still holds the contents its hash was taken of.
+		static bool Verify(SQLSession& copy);
+		~SaveDB();
+	};
+} // namespace ZomboidHook
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+namespace ZomboidHook {
+	// A save can be spread over several databases, its shards, so that each has
+	// a writer of its own. A file is only ever looked for in the shard its name
+	// leads to, so every shard records how many there are, and changing that
+	// takes ZomboidTool reshard. Shard 0 is the database of an unsharded save.
+
+	// Which of count shards name belongs in. Chunks go by map region, so that
+	// neighbours are stored together, anything else by a hash of the name.
+	[[nodiscard]] uint32_t ShardOf(std::string_view name,
+																 uint32_t count) noexcept;
+	// Where the database of shard index of the save in saveDir is.
+	[[nodiscard]] std::filesystem::path
+			ShardPath(const std::filesystem::path& saveDir, uint32_t index);
+	// How many shards the save in saveDir has, one if it has no database yet.
+	[[nodiscard]] uint32_t ShardCount(const std::filesystem::path& saveDir);
+} // namespace ZomboidHook
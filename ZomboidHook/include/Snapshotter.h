@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "SQLite.h"
+
+namespace ZomboidHook {
+	struct SnapshotPolicy {
+		std::chrono::minutes interval{0}; // None are taken while zero.
+		uint32_t keep = 8;								// The oldest beyond these are deleted.
+		// Where the snapshots of every save go, next to each database if empty.
+		std::filesystem::path dir;
+		int pagesPerStep = 512;
+		std::chrono::milliseconds stepPause{10};
+	};
+
+	// Copies a live database to timestamped files while it stays in use. The
+	// copy goes through the online backup API a few pages at a time from a
+	// read-only connection of its own, whose read transaction pins one state of
+	// the database throughout. In WAL mode that never blocks the writer, and
+	// commits made meanwhile neither restart the copy nor end up in it. The
+	// pauses between steps leave the disk to the game. Each copy is verified
+	// before it replaces the oldest one kept.
+	// The shards of a save are taken together: every one is pinned before any
+	// is copied, and the copies share a timestamp and are kept or dropped as a
+	// set, which is what a sharded save is restored from.
+	class Snapshotter {
+	public:
+		// Checks the contents of a finished copy, opened read-only.
+		using VerifyFn = std::function<bool(SQLSession&)>;
+
+	private:
+		std::vector<std::filesystem::path> sources;
+		std::filesystem::path dir;
+		SnapshotPolicy policy;
+		VerifyFn verify;
+		std::mutex mutex;
+		std::condition_variable_any wake;
+		std::jthread worker; // do not reorder, must stop before the above.
+
+		// Waits for duration, returning false if stopped meanwhile.
+		bool Pause(std::stop_token& stop, std::chrono::milliseconds duration);
+		// Opens a read transaction on source, fixing the state it copies.
+		static SQLConn Pin(const std::filesystem::path& source);
+		void Copy(SQLConn& from,
+							const std::filesystem::path& to,
+							std::stop_token& stop);
+		void Verify(const std::filesystem::path& copy);
+		void Prune(const std::filesystem::path& source);
+		void Run(std::stop_token stop);
+
+	public:
+		// Takes a snapshot of the sources, the shards of a save in order, into
+		// dir every interval of the policy.
+		Snapshotter(std::vector<std::filesystem::path> sources,
+								std::filesystem::path dir,
+								SnapshotPolicy policy,
+								VerifyFn verify = {});
+		Snapshotter(const Snapshotter&) = delete;
+		// Where the snapshots of the save in saveDir go under policy.
+		static std::filesystem::path DirFor(const SnapshotPolicy& policy,
+																				const std::filesystem::path& saveDir);
+		// Takes a snapshot now and returns its paths, one per source. Throws if
+		// it fails or is stopped, leaving no file behind.
+		std::vector<std::filesystem::path> Take(std::stop_token stop = {});
+	};
+} // namespace ZomboidHook
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "interface/IFileOps.h"
+
+namespace ZomboidHook {
+	// IFileOps on top of the standard library for code that runs outside the
+	// game, where there are no hooks to bypass. Files are read into memory
+	// rather than mapped, and shared files are only kept in memory.
+	class StdFileOps : public IFileOps {
+	public:
+		bool FileExists(const std::filesystem::path& path) noexcept override;
+		std::unique_ptr<IMemMappedFile>
+				MemMapFile(const std::filesystem::path& path) override;
+		FileTimes GetFileTimes(const std::filesystem::path& path) override;
+		std::unique_ptr<IMemMappedFile>
+				MapSharedFile(const std::filesystem::path& path, size_t len) override;
+	};
+} // namespace ZomboidHook
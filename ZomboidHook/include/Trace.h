@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace ZomboidHook {
+	enum class TraceOp : uint8_t
+	{
+		PATH, // Names path id; arg bytes of the UTF-8 path follow the record.
+		OPEN_ONLY,
+		CREATE_ONLY,
+		OPEN_OR_CREATE,
+		CREATE_AND_WIPE,
+		OPEN_ONLY_AND_WIPE,
+		READ,
+		WRITE,
+		SEEK,
+		TRUNCATE_TO_CURSOR,
+		TRUNCATE,
+		DELETE,
+		CLOSED,
+		SET_ATTRIB,
+		GET_SIZE,
+		GET_ATTRIB,
+		GET_TIMES,
+		READ_AT,
+		WRITE_AT,
+		APPEND,
+		FLUSH,
+	};
+
+	// One call at the IOSCallHandler boundary. Only lengths are kept of the data
+	// read or written, which is all a replay needs to reproduce the load.
+	struct TraceRecord {
+		uint64_t time		 = 0; // Since the trace started, in ns.
+		uint32_t latency = 0; // Of the call, in ns, saturating.
+		uint32_t path		 = 0;
+		int64_t handle	 = 0;
+		int64_t arg			 = 0; // Length asked for, seek distance, new length, or
+													// the offset of a READ_AT or WRITE_AT.
+		int64_t result	 = 0; // Length done, new offset or size.
+		TraceOp op			 = TraceOp::PATH;
+		uint8_t intent	 = 0; // The FileIntent or FileAttribute returned.
+		uint8_t mode		 = 0; // The SeekFrom, or whether a size was stateless.
+		std::array<uint8_t, 5> reserved{};
+	};
+	static_assert(sizeof(TraceRecord) == 48);
+
+	inline constexpr std::array<char, 8> traceMagic{
+			'Z', 'D', 'B', 'T', 'R', 'C', '0', '1'};
+
+	// Appends records to a trace file from any number of threads. Records are
+	// buffered and written out in large blocks, so tracing costs a lock and a
+	// copy per call. The file uses the native byte order.
+	class TraceWriter {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+	private:
+		std::FILE* file;
+		Clock::time_point start = Clock::now();
+		std::mutex mutex;
+		std::vector<uint8_t> buf;
+		std::unordered_map<std::filesystem::path::string_type, uint32_t> paths;
+
+		void Append(const void* data, size_t len);
+		void FlushLocked() noexcept;
+
+	public:
+		explicit TraceWriter(const std::filesystem::path& path);
+		TraceWriter(const TraceWriter&) = delete;
+		// Fills in the path and the times of record, which was called at begin.
+		void Write(TraceRecord record,
+							 const std::filesystem::path& path,
+							 Clock::time_point begin);
+		~TraceWriter();
+	};
+
+	class TraceReader {
+		std::FILE* file;
+		std::vector<std::filesystem::path> paths;
+
+	public:
+		explicit TraceReader(const std::filesystem::path& path);
+		TraceReader(const TraceReader&) = delete;
+		// The next call, with path definitions taken in along the way.
+		std::optional<TraceRecord> Next();
+		[[nodiscard]] const std::filesystem::path& Path(uint32_t id) const;
+		~TraceReader();
+	};
+} // namespace ZomboidHook
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+
+#include "Trace.h"
+#include "interface/IOSCallHandler.h"
+
+namespace ZomboidHook {
+	// Passes every call on to another handler and records it, along with what
+	// came back and how long it took, so a workload can be replayed elsewhere.
+	class TracingHandler : public IOSCallHandler {
+		std::unique_ptr<IOSCallHandler> inner;
+		TraceWriter trace;
+
+		template <typename Fn>
+		FileIntent Record(TraceRecord record,
+											const std::filesystem::path& path,
+											Fn&& fn);
+
+	public:
+		TracingHandler(std::unique_ptr<IOSCallHandler> inner,
+									 const std::filesystem::path& tracePath);
+		[[nodiscard]] bool MayIntercept(PathView path) const noexcept override;
+		[[nodiscard]] FileIntent FileOpenOnly(FileInfo info) override;
+		[[nodiscard]] FileIntent FileCreateOnly(FileInfo info) override;
+		[[nodiscard]] FileIntent FileOpenOrCreate(FileInfo info) override;
+		[[nodiscard]] FileIntent FileCreateAndWipe(FileInfo info) override;
+		[[nodiscard]] FileIntent FileOpenOnlyAndWipe(FileInfo info) override;
+		[[nodiscard]] FileIntent
+				FileRead(FileInfo info, uint8_t* buf, uint32_t& readLen) override;
+		[[nodiscard]] FileIntent FileWrite(FileInfo info,
+																			 const uint8_t* buf,
+																			 uint32_t& writeLen) override;
+		[[nodiscard]] FileIntent FileReadAt(FileInfo info,
+																				uint8_t* buf,
+																				uint32_t& readLen,
+																				uint64_t offset) override;
+		[[nodiscard]] FileIntent FileWriteAt(FileInfo info,
+																				 const uint8_t* buf,
+																				 uint32_t& writeLen,
+																				 uint64_t offset) override;
+		[[nodiscard]] FileIntent FileAppend(FileInfo info,
+																				const uint8_t* buf,
+																				uint32_t& writeLen) override;
+		[[nodiscard]] FileIntent FileFlush(FileInfo info) override;
+		[[nodiscard]] FileIntent
+				FileSeek(FileInfo info, SeekFrom pos, int64_t& distance) override;
+		[[nodiscard]] FileIntent FileTruncateToCursor(FileInfo info) override;
+		[[nodiscard]] FileIntent FileTruncate(FileInfo info, uint64_t len) override;
+		[[nodiscard]] FileIntent
+				FileDelete(const std::filesystem::path& path) override;
+		[[nodiscard]] FileIntent
+				FileSetAttrib(const std::filesystem::path& path) override;
+		[[nodiscard]] FileIntent FileGetSize(FileInfo info,
+																				 uint64_t& sizeOut,
+																				 bool isStateless) override;
+		[[nodiscard]] FileAttribute
+				FileGetAttrib(const std::filesystem::path& path) override;
+		[[nodiscard]] FileTimes
+				FileGetTimes(const std::filesystem::path& path) override;
+		void FileClosed(FileInfo info) override;
+	};
+} // namespace ZomboidHook
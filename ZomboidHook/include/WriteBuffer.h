@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ZomboidHook {
+	// Collects the writes made through a single handle so that they reach the
+	// database as one upsert rather than a blob rewrite per call. The buffer may
+	// start at a base offset, the bytes before it being left as they are stored
+	// and never loaded; writes and resizes must then stay at or past the base.
+	class WriteBuffer {
+		uint64_t base = 0;
+		std::vector<uint8_t> data; // From base on.
+
+	public:
+		void Assign(std::vector<uint8_t>&& buf, uint64_t at = 0) noexcept;
+		// Puts the bytes before the base in front, so that the buffer starts at
+		// offset zero.
+		void Prepend(const std::vector<uint8_t>& head);
+		// The contents, for handing them over without a copy.
+		[[nodiscard]] std::vector<uint8_t>& Bytes() noexcept;
+		void Write(const uint8_t* buf, size_t len, size_t offset);
+		void Resize(size_t len);
+		[[nodiscard]] std::pair<const uint8_t*, size_t> Data() const noexcept;
+		[[nodiscard]] uint64_t Base() const noexcept;
+		// Including the bytes before the base.
+		[[nodiscard]] uint64_t Size() const noexcept;
+	};
+} // namespace ZomboidHook
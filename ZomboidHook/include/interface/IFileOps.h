@@ -1,18 +1,22 @@
-#pragma once
-
-#include <filesystem>
-#include <memory>
-
-#include "FileTimes.h"
-#include "interface/IMemMappedFile.h"
-
-namespace ZomboidHook {
-	class IFileOps {
-	public:
-		virtual bool FileExists(const std::filesystem::path& path) noexcept = 0;
-		virtual std::unique_ptr<IMemMappedFile>
-				MemMapFile(const std::filesystem::path& path)									= 0;
-		virtual FileTimes GetFileTimes(const std::filesystem::path& path) = 0;
-		virtual ~IFileOps()																								= default;
-	};
+#pragma once
+
+#include <filesystem>
+#include <memory>
+
+#include "FileTimes.h"
+#include "interface/IMemMappedFile.h"
+
+namespace ZomboidHook {
+	class IFileOps {
+	public:
+		virtual bool FileExists(const std::filesystem::path& path) noexcept = 0;
+		virtual std::unique_ptr<IMemMappedFile>
+				MemMapFile(const std::filesystem::path& path)									= 0;
+		virtual FileTimes GetFileTimes(const std::filesystem::path& path) = 0;
+		// Creates or resizes path to len bytes and maps it writable, shared with
+		// any other process that opens it.
+		virtual std::unique_ptr<IMemMappedFile>
+				MapSharedFile(const std::filesystem::path& path, size_t len) = 0;
+		virtual ~IFileOps() = default;
+	};
 } // namespace ZomboidHook
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "HandleRegistry.h"
+#include "HandlerLock.h"
+#include "interface/IFileOps.h"
+#include "interface/IOSCallHandler.h"
+
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+
+namespace ZomboidHook {
+	// The next definitions of the interposed calls, normally libc's.
+	struct LibcFunctions {
+		decltype(::openat)* openat;
+		decltype(::read)* read;
+		decltype(::pread)* pread;
+		decltype(::write)* write;
+		decltype(::pwrite)* pwrite;
+		decltype(::lseek)* lseek;
+		decltype(::fstat)* fstat;
+		decltype(::stat)* stat;
+		decltype(::fstatat)* fstatat;
+		decltype(::statx)* statx;
+		decltype(::ftruncate)* ftruncate;
+		decltype(::unlink)* unlink;
+		decltype(::remove)* remove;
+		decltype(::close)* close;
+		decltype(::fsync)* fsync;
+		decltype(::fdatasync)* fdatasync;
+		LibcFunctions() noexcept;
+	};
+	class Interposer : public IFileOps {
+		struct InterceptedFd {
+			std::filesystem::path path;
+			bool append;
+		};
+		// One of our descriptors, locked along with the handler.
+		struct LockedFd {
+			HandleRegistry<InterceptedFd>::Ref ref;
+			HandlerLock lock;
+
+			explicit operator bool() const noexcept {
+				return static_cast<bool>(ref);
+			}
+
+			InterceptedFd* operator->() const noexcept {
+				return &*ref;
+			}
+		};
+
+		std::shared_mutex handlerMutex; // Exclusive only to unregister.
+		std::unique_ptr<IOSCallHandler> oscHandler;
+		HandleRegistry<InterceptedFd> interceptedFds;
+
+		LockedFd Find(int fd);
+		bool MayIntercept(const char* file) const noexcept;
+		// Fill in buf for our files, with errno set when they FAIL. StatAt takes
+		// the flags of fstatat().
+		FileIntent StatFd(int fd, struct stat& buf);
+		FileIntent StatAt(int dirFd, const char* file, int flags, struct stat& buf);
+		int Unlink(const char* file, decltype(::unlink)* real);
+
+	public:
+		static Interposer& Instance() noexcept;
+		static const LibcFunctions& Libc() noexcept;
+		Interposer() noexcept;
+		void RegisterHandler(std::unique_ptr<IOSCallHandler>&& oscHandler);
+		void UnregisterHandler() noexcept;
+
+		int Open(int dirFd, const char* file, int flags, mode_t mode);
+		ssize_t Read(int fd, void* buf, size_t count);
+		ssize_t PRead(int fd, void* buf, size_t count, off_t offset);
+		ssize_t Write(int fd, const void* buf, size_t count);
+		ssize_t PWrite(int fd, const void* buf, size_t count, off_t offset);
+		off_t LSeek(int fd, off_t offset, int whence);
+		int FStat(int fd, struct stat* buf);
+		int Stat(const char* file, struct stat* buf);
+		int LStat(const char* file, struct stat* buf);
+		int FStatAt(int dirFd, const char* file, struct stat* buf, int flags);
+		int StatX(int dirFd,
+							const char* file,
+							int flags,
+							unsigned int mask,
+							struct statx* buf);
+		int FTruncate(int fd, off_t len);
+		int Unlink(const char* file);
+		int Remove(const char* file);
+		int Close(int fd);
+		// For fsync() and fdatasync(), which are the same to the handler.
+		int Sync(int fd, decltype(::fsync)* real);
+
+		bool FileExists(const std::filesystem::path& path) noexcept override;
+		std::unique_ptr<IMemMappedFile>
+				MemMapFile(const std::filesystem::path& path) override;
+		FileTimes GetFileTimes(const std::filesystem::path& path) override;
+		std::unique_ptr<IMemMappedFile>
+				MapSharedFile(const std::filesystem::path& path, size_t len) override;
+		~Interposer();
+	};
+} // namespace ZomboidHook
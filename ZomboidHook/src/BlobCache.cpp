@@ -0,0 +1,139 @@
+#include "BlobCache.h"
+
+#include <functional>
+#include <string_view>
+
+#include "Metrics.h"
+
+using namespace ZomboidHook;
+
+size_t BlobCache::KeyHash::operator()(const Key& key) const noexcept {
+	auto hash = std::hash<std::string_view>{}(key.name);
+	return hash ^ (std::hash<const void*>{}(key.owner) + 0x9e3779b97f4a7c15 +
+								 (hash << 6) + (hash >> 2));
+}
+
+BlobCache& BlobCache::Instance() noexcept {
+	// Never destroyed, as databases can still close while the process exits.
+	static auto& instance = *new BlobCache;
+	return instance;
+}
+
+BlobCache::Shard& BlobCache::ShardOf(const Key& key) noexcept {
+	// The low bits pick the bucket within the shard, so use the high ones.
+	auto hash = KeyHash{}(key);
+	return shards[(hash >> (sizeof(size_t) * 8 - 4)) % shardCount];
+}
+
+void BlobCache::Drop(Shard& shard, const Key& key) noexcept {
+	auto it = shard.entries.find(key);
+	if (it == shard.entries.end())
+		return;
+	auto len = it->second->data->size();
+	shard.bytes -= len;
+	Metrics::Instance().Block().blobCached.fetch_sub(len,
+																									 std::memory_order_relaxed);
+	shard.lru.erase(it->second);
+	shard.entries.erase(it);
+}
+
+void BlobCache::Add(Shard& shard, Key&& key, Contents data) {
+	auto len = data->size();
+	if (!Fits(len))
+		return;
+	while (shard.bytes + len > shardBudget.load(std::memory_order_relaxed))
+		Drop(shard, shard.lru.back().key);
+	shard.lru.push_front({key, std::move(data)});
+	shard.entries.emplace(std::move(key), shard.lru.begin());
+	shard.bytes += len;
+	Metrics::Instance().Block().blobCached.fetch_add(len,
+																									 std::memory_order_relaxed);
+}
+
+void BlobCache::SetBudget(size_t bytes) {
+	shardBudget.store(bytes / shardCount, std::memory_order_relaxed);
+	for (auto& shard : shards) {
+		std::lock_guard l{shard.mutex};
+		while (shard.bytes > bytes / shardCount)
+			Drop(shard, shard.lru.back().key);
+	}
+}
+
+bool BlobCache::Fits(size_t len) const noexcept {
+	auto budget = shardBudget.load(std::memory_order_relaxed);
+	return budget > 0 && len <= budget;
+}
+
+BlobCache::Contents BlobCache::Find(const void* owner,
+																		const std::string& name) {
+	auto& block = Metrics::Instance().Block();
+	if (shardBudget.load(std::memory_order_relaxed) == 0)
+		return nullptr;
+	Key key{owner, name};
+	auto& shard = ShardOf(key);
+	std::lock_guard l{shard.mutex};
+	auto it = shard.entries.find(key);
+	if (it == shard.entries.end()) {
+		block.blobMisses.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+	block.blobHits.fetch_add(1, std::memory_order_relaxed);
+	return it->second->data;
+}
+
+uint64_t BlobCache::Stamp(const void* owner, const std::string& name) {
+	Key key{owner, name};
+	auto& shard = ShardOf(key);
+	std::lock_guard l{shard.mutex};
+	return shard.changes;
+}
+
+void BlobCache::Insert(const void* owner,
+											 const std::string& name,
+											 Contents data,
+											 uint64_t stamp) {
+	if (!Fits(data->size()))
+		return;
+	Key key{owner, name};
+	auto& shard = ShardOf(key);
+	std::lock_guard l{shard.mutex};
+	// Any change to the shard since might have been to name, and data could
+	// then be older than what the database holds now.
+	if (shard.changes != stamp || shard.entries.contains(key))
+		return;
+	Add(shard, std::move(key), std::move(data));
+}
+
+void BlobCache::Put(const void* owner,
+										const std::string& name,
+										Contents data) {
+	Key key{owner, name};
+	auto& shard = ShardOf(key);
+	std::lock_guard l{shard.mutex};
+	++shard.changes;
+	Drop(shard, key);
+	Add(shard, std::move(key), std::move(data));
+}
+
+void BlobCache::Invalidate(const void* owner, const std::string& name) {
+	if (shardBudget.load(std::memory_order_relaxed) == 0)
+		return;
+	Key key{owner, name};
+	auto& shard = ShardOf(key);
+	std::lock_guard l{shard.mutex};
+	++shard.changes;
+	Drop(shard, key);
+}
+
+void BlobCache::Clear(const void* owner) {
+	for (auto& shard : shards) {
+		std::lock_guard l{shard.mutex};
+		++shard.changes;
+		for (auto it = shard.lru.begin(); it != shard.lru.end();) {
+			auto entry = it++;
+			if (entry->key.owner == owner)
+				Drop(shard, entry->key);
+		}
+	}
+}
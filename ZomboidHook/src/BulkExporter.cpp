@@ -0,0 +1,172 @@
+#include "BulkExporter.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SaveDB.h"
+#include "Shards.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+namespace {
+	struct ExportedFile {
+		std::string name;
+		std::optional<std::vector<uint8_t>> data; // None if deleted.
+
+		size_t Size() const noexcept {
+			return data ? data->size() : 0;
+		}
+	};
+
+	// Hands files from the shard readers to the writers while capping how many
+	// bytes are held in memory at once. Ends once every reader is done.
+	class ExportQueue {
+		std::mutex mutex;
+		std::condition_variable hasSpace;
+		std::condition_variable hasFiles;
+		std::deque<ExportedFile> files;
+		size_t bytes = 0;
+		size_t limit;
+		size_t readers;
+
+	public:
+		ExportQueue(size_t limit, size_t readers) :
+				limit{limit}, readers{readers} {}
+
+		void Push(ExportedFile file) {
+			std::unique_lock l{mutex};
+			auto len = file.Size();
+			hasSpace.wait(l, [&] { return bytes == 0 || bytes + len <= limit; });
+			bytes += len;
+			files.push_back(std::move(file));
+			hasFiles.notify_one();
+		}
+
+		void ReaderDone() {
+			std::lock_guard l{mutex};
+			if (--readers == 0)
+				hasFiles.notify_all();
+		}
+
+		std::optional<ExportedFile> Pop() {
+			std::unique_lock l{mutex};
+			hasFiles.wait(l, [&] { return !files.empty() || readers == 0; });
+			if (files.empty())
+				return std::nullopt;
+			auto file = std::move(files.front());
+			files.pop_front();
+			bytes -= file.Size();
+			hasSpace.notify_all();
+			return file;
+		}
+	};
+} // namespace
+
+BulkExporter::BulkExporter(IFileOps& fileOps,
+													 Options options,
+													 ProgressFn onProgress) :
+		fileOps{fileOps},
+		options{options},
+		onProgress{std::move(onProgress)} {}
+
+bool BulkExporter::Identical(const fs::path& path,
+														 const std::vector<uint8_t>& data) {
+	std::error_code ec;
+	auto size = fs::file_size(path, ec);
+	if (ec || size != data.size())
+		return false;
+	if (data.empty())
+		return true;
+	try {
+		auto disk = fileOps.MemMapFile(path);
+		return std::memcmp(disk->data(), data.data(), data.size()) == 0;
+	} catch (const std::exception&) {
+		return false; // Unreadable, so written anew.
+	}
+}
+
+ExportProgress BulkExporter::Export(const fs::path& saveDir,
+																		const fs::path& into) {
+	fs::create_directories(into);
+	auto shards = ShardCount(saveDir);
+	ExportQueue queue{options.inFlightBytes, shards};
+	ExportProgress progress;
+	size_t handled = 0;
+	std::mutex progressMutex;
+	std::vector<std::exception_ptr> errors(shards + 1);
+
+	std::vector<std::jthread> threads;
+	for (uint32_t i = 0; i < shards; ++i)
+		threads.emplace_back([&, i] {
+			try {
+				SaveDB db{ShardPath(saveDir, i),
+									{.durability = Durability::PER_OP},
+									{.shards = shards}};
+				db.ForEachFile([&](auto& name, auto data) {
+					queue.Push({name, std::move(data)});
+				});
+			} catch (...) {
+				errors[i] = std::current_exception();
+			}
+			queue.ReaderDone();
+		});
+	for (auto i = std::max(options.writers, 1u); i > 0; --i)
+		threads.emplace_back([&] {
+			// After a failure the queue is still drained, so that no reader waits on
+			// it forever.
+			while (auto file = queue.Pop()) {
+				ExportProgress done;
+				try {
+					auto path = into / file->name;
+					if (!file->data) {
+						std::error_code ec;
+						done.filesRemoved = fs::remove(path, ec);
+					} else if (options.incremental && Identical(path, *file->data))
+						done.filesSkipped = 1;
+					else {
+						// Unbuffered, so that the whole file goes out in a single write.
+						std::ofstream out;
+						out.rdbuf()->pubsetbuf(nullptr, 0);
+						out.open(path, std::ios::binary | std::ios::trunc);
+						auto& data = *file->data;
+						out.write(reinterpret_cast<const char*>(data.data()), data.size());
+						out.close();
+						if (!out) [[unlikely]]
+							throw std::runtime_error{"Failed to write " + path.string()};
+						done.filesDone = 1;
+						done.bytesDone = data.size();
+					}
+				} catch (...) {
+					std::lock_guard l{progressMutex};
+					if (!errors.back())
+						errors.back() = std::current_exception();
+				}
+				std::lock_guard l{progressMutex};
+				progress.filesDone += done.filesDone;
+				progress.filesSkipped += done.filesSkipped;
+				progress.filesRemoved += done.filesRemoved;
+				progress.bytesDone += done.bytesDone;
+				if (onProgress && ++handled % 256 == 0)
+					onProgress(progress);
+			}
+		});
+	threads.clear();
+
+	for (auto& error : errors)
+		if (error)
+			std::rethrow_exception(error);
+	if (onProgress)
+		onProgress(progress);
+	return progress;
+}
@@ -0,0 +1,229 @@
+#include "BulkMigrator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SaveDB.h"
+#include "Shards.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+namespace {
+	struct LoadedFile {
+		std::string name;
+		std::unique_ptr<IMemMappedFile> data;
+		Digest digest;
+		Codec codec = Codec::NONE;
+		std::vector<uint8_t> packed;
+		uint32_t shard = 0;
+
+		std::pair<const uint8_t*, size_t> Stored() const {
+			if (codec != Codec::NONE)
+				return {packed.data(), packed.size()};
+			return {data->data(), data->size()};
+		}
+	};
+
+	// Hands files from the reader threads to the writer while capping how many
+	// bytes are held in memory at once.
+	class LoadQueue {
+		std::mutex mutex;
+		std::condition_variable hasSpace;
+		std::condition_variable hasFiles;
+		std::deque<LoadedFile> files;
+		size_t bytes = 0;
+		size_t limit;
+		bool closed = false;
+
+	public:
+		explicit LoadQueue(size_t limit) : limit{limit} {}
+
+		// Returns false once the queue is closed, dropping file.
+		bool Push(LoadedFile file) {
+			std::unique_lock l{mutex};
+			auto len = file.data ? file.data->size() : 0;
+			hasSpace.wait(
+					l, [&] { return closed || bytes == 0 || bytes + len <= limit; });
+			if (closed)
+				return false;
+			bytes += len;
+			files.push_back(std::move(file));
+			hasFiles.notify_one();
+			return true;
+		}
+
+		// Lets go of the readers once the writer has given up.
+		void Close() {
+			std::lock_guard l{mutex};
+			closed = true;
+			files.clear();
+			bytes = 0;
+			hasSpace.notify_all();
+		}
+
+		LoadedFile Pop() {
+			std::unique_lock l{mutex};
+			hasFiles.wait(l, [&] { return !files.empty(); });
+			auto file = std::move(files.front());
+			files.pop_front();
+			bytes -= file.data ? file.data->size() : 0;
+			hasSpace.notify_all();
+			return file;
+		}
+	};
+
+	// Chunks go first and in key order, so that their blobs are laid out along
+	// the same curve as their keys.
+	bool InsertOrder(std::string_view lhs, std::string_view rhs) noexcept {
+		auto lhsKey = ChunkKey(lhs).value_or(INT64_MAX);
+		auto rhsKey = ChunkKey(rhs).value_or(INT64_MAX);
+		return lhsKey != rhsKey ? lhsKey < rhsKey : lhs < rhs;
+	}
+} // namespace
+
+BulkMigrator::BulkMigrator(IFileOps& fileOps,
+													 Options options,
+													 ProgressFn onProgress) :
+		fileOps{fileOps},
+		options{options},
+		onProgress{std::move(onProgress)} {}
+
+MigrationProgress BulkMigrator::Migrate(const fs::path& saveDir) {
+	auto shards = options.shards ? options.shards : ShardCount(saveDir);
+	// Batches are committed explicitly below, so grouping is not wanted here.
+	std::vector<std::unique_ptr<SaveDB>> dbs;
+	for (uint32_t i = 0; i < shards; ++i)
+		dbs.push_back(std::make_unique<SaveDB>(
+				ShardPath(saveDir, i),
+				CommitPolicy{.durability = Durability::PER_OP},
+				StorageOptions{.codec = options.codec, .shards = shards}));
+	std::vector<fs::path> pending;
+	for (auto& entry : fs::directory_iterator{saveDir}) {
+		if (!entry.is_regular_file() || entry.path().extension() != ".bin")
+			continue;
+		auto name = entry.path().filename().string();
+		if (!dbs[ShardOf(name, shards)]->Exists(name))
+			pending.push_back(entry.path());
+	}
+	std::sort(pending.begin(), pending.end(), [](auto& lhs, auto& rhs) {
+		return InsertOrder(lhs.filename().string(), rhs.filename().string());
+	});
+
+	MigrationProgress progress{.filesTotal = pending.size()};
+	if (pending.empty())
+		return progress;
+	// Trade crash safety of the import itself for speed: an interrupted batch
+	// is simply redone by the next run.
+	for (auto& db : dbs) {
+		db->Execute("PRAGMA cache_size=-262144");
+		db->Execute("PRAGMA synchronous=OFF");
+		db->Execute("PRAGMA wal_autocheckpoint=16384");
+	}
+
+	LoadQueue queue{options.inFlightBytes};
+	std::atomic<size_t> next{0};
+	std::vector<std::jthread> readers;
+	for (auto i = std::max(options.readers, 1u); i > 0; --i)
+		readers.emplace_back([&] {
+			for (auto idx = next++; idx < pending.size(); idx = next++) {
+				LoadedFile file;
+				file.name = pending[idx].filename().string();
+				try {
+					file.data = fileOps.MemMapFile(pending[idx]);
+					std::pair contents{file.data->data(), file.data->size()};
+					file.digest = HashContent(contents);
+					if (Encode(options.codec, contents, file.packed))
+						file.codec = options.codec;
+				} catch (const std::exception&) {
+					// Left on disk; the hook still migrates it lazily if it can.
+				}
+				if (!queue.Push(std::move(file)))
+					return;
+			}
+		});
+
+	std::vector<LoadedFile> batch;
+	size_t batchBytes = 0;
+
+	// A mutation of its own, as the databases do not group, so the batch is
+	// one transaction that throws if it fails to commit and is rolled back.
+	auto commitShard = [&](uint32_t shard) {
+		auto& db			= *dbs[shard];
+		auto mutation = db.Mutate();
+		for (auto& file : batch)
+			if (file.shard == shard)
+				db.PutBlob(file.name,
+									 file.digest,
+									 file.Stored(),
+									 file.codec,
+									 file.data->size());
+	};
+	auto commitBatch = [&] {
+		std::sort(batch.begin(), batch.end(), [](auto& lhs, auto& rhs) {
+			return InsertOrder(lhs.name, rhs.name);
+		});
+		if (shards == 1)
+			commitShard(0);
+		else {
+			std::vector<std::exception_ptr> errors(shards);
+			{
+				std::vector<std::jthread> writers;
+				for (uint32_t i = 0; i < shards; ++i)
+					writers.emplace_back([&, i] {
+						try {
+							commitShard(i);
+						} catch (...) {
+							errors[i] = std::current_exception();
+						}
+					});
+			}
+			for (auto& error : errors)
+				if (error)
+					std::rethrow_exception(error);
+		}
+		progress.filesDone += batch.size();
+		progress.bytesDone += batchBytes;
+		batch.clear();
+		batchBytes = 0;
+		if (onProgress)
+			onProgress(progress);
+	};
+	try {
+		for (size_t received = 0; received < pending.size(); ++received) {
+			auto file = queue.Pop();
+			if (!file.data) {
+				++progress.filesFailed;
+				continue;
+			}
+			file.shard = ShardOf(file.name, shards);
+			batchBytes += file.data->size();
+			batch.push_back(std::move(file));
+			if (batchBytes >= options.batchBytes ||
+					batch.size() >= options.batchFiles)
+				commitBatch();
+		}
+		if (!batch.empty())
+			commitBatch();
+	} catch (...) {
+		// The readers would otherwise wait for space forever, and are joined on
+		// the way out.
+		queue.Close();
+		throw;
+	}
+
+	for (auto& db : dbs) {
+		db->Execute("PRAGMA synchronous=NORMAL");
+		db->Execute("PRAGMA wal_checkpoint(TRUNCATE)");
+	}
+	return progress;
+}
@@ -0,0 +1,80 @@
+#include "ChunkKey.h"
+
+#include <array>
+#include <charconv>
+#include <stdexcept>
+
+using namespace ZomboidHook;
+
+namespace {
+	constexpr std::array<std::string_view, 3> families{
+			"chunkdata_", "map_", "zpop_"};
+	constexpr unsigned coordBits	= chunkCoordBits;
+	constexpr uint32_t coordLimit = 1u << coordBits;
+
+	// Parses a canonically written coordinate off the front of str.
+	std::optional<uint32_t> TakeCoord(std::string_view& str) noexcept {
+		uint32_t value;
+		auto [end, ec] =
+				std::from_chars(str.data(), str.data() + str.size(), value);
+		auto len = static_cast<size_t>(end - str.data());
+		if (ec != std::errc{} || value >= coordLimit || (len > 1 && str[0] == '0'))
+			return std::nullopt;
+		str.remove_prefix(len);
+		return value;
+	}
+
+	// Spreads the low 24 bits of v out to the even bits.
+	uint64_t Spread(uint64_t v) noexcept {
+		v = (v | v << 16) & 0x0000ffff0000ffff;
+		v = (v | v << 8) & 0x00ff00ff00ff00ff;
+		v = (v | v << 4) & 0x0f0f0f0f0f0f0f0f;
+		v = (v | v << 2) & 0x3333333333333333;
+		v = (v | v << 1) & 0x5555555555555555;
+		return v;
+	}
+
+	// Gathers the even bits of v back into the low 24.
+	uint32_t Compact(uint64_t v) noexcept {
+		v &= 0x5555555555555555;
+		v = (v | v >> 1) & 0x3333333333333333;
+		v = (v | v >> 2) & 0x0f0f0f0f0f0f0f0f;
+		v = (v | v >> 4) & 0x00ff00ff00ff00ff;
+		v = (v | v >> 8) & 0x0000ffff0000ffff;
+		v = (v | v >> 16) & 0x00000000ffffffff;
+		return static_cast<uint32_t>(v);
+	}
+} // namespace
+
+std::optional<int64_t> ZomboidHook::ChunkKey(std::string_view name) noexcept {
+	if (!name.ends_with(".bin"))
+		return std::nullopt;
+	name.remove_suffix(4);
+	for (size_t family = 0; family < families.size(); ++family) {
+		if (!name.starts_with(families[family]))
+			continue;
+		name.remove_prefix(families[family].size());
+		auto x = TakeCoord(name);
+		if (!x || !name.starts_with('_'))
+			return std::nullopt;
+		name.remove_prefix(1);
+		auto y = TakeCoord(name);
+		if (!y || !name.empty())
+			return std::nullopt;
+		return static_cast<int64_t>((family + 1) << 2 * coordBits |
+																Spread(*x) | Spread(*y) << 1);
+	}
+	return std::nullopt;
+}
+
+std::string ZomboidHook::ChunkName(int64_t key) {
+	auto family = static_cast<uint64_t>(key) >> 2 * coordBits;
+	auto coords = static_cast<uint64_t>(key) ^ family << 2 * coordBits;
+	if (family == 0 || family > families.size()) [[unlikely]]
+		throw std::runtime_error{"Not a chunk key"};
+	std::string name{families[family - 1]};
+	name += std::to_string(Compact(coords));
+	name += '_';
+	name += std::to_string(Compact(coords >> 1));
+	return name += ".bin";
+}
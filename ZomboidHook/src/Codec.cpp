@@ -0,0 +1,163 @@
+#include "Codec.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+using namespace ZomboidHook;
+
+namespace {
+	// Limits of the LZ4 block format: matches are at least minMatch long, the
+	// last lastLiterals bytes are always literals and no match starts within
+	// matchMargin bytes of the end.
+	constexpr size_t minMatch		 = 4;
+	constexpr size_t lastLiterals = 5;
+	constexpr size_t matchMargin	 = 12;
+	constexpr size_t maxOffset		 = 65535;
+	constexpr unsigned hashBits	 = 13;
+
+	uint32_t Read32(const uint8_t* p) noexcept {
+		uint32_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	uint32_t Hash(uint32_t value) noexcept {
+		return (value * 2654435761u) >> (32 - hashBits);
+	}
+
+	void PutLength(std::vector<uint8_t>& out, size_t len) {
+		for (; len >= 255; len -= 255)
+			out.push_back(255);
+		out.push_back(static_cast<uint8_t>(len));
+	}
+
+	void PutLiterals(std::vector<uint8_t>& out,
+									 const uint8_t* src,
+									 size_t len,
+									 uint8_t matchNibble) {
+		out.push_back(
+				static_cast<uint8_t>(std::min<size_t>(len, 15) << 4 | matchNibble));
+		if (len >= 15)
+			PutLength(out, len - 15);
+		out.insert(out.end(), src, src + len);
+	}
+
+	bool CompressLZ(const uint8_t* src, size_t len, std::vector<uint8_t>& out) {
+		auto budget = len - len / 8;
+		std::array<uint32_t, 1 << hashBits> table{};
+		size_t anchor = 0;
+		size_t pos		= 1; // table is zeroed, so position 0 is always a candidate.
+		while (pos + matchMargin <= len) {
+			auto seq		 = Read32(src + pos);
+			auto& entry	 = table[Hash(seq)];
+			size_t cand	 = entry;
+			entry				 = static_cast<uint32_t>(pos);
+			if (pos - cand > maxOffset || Read32(src + cand) != seq) {
+				pos += 1 + ((pos - anchor) >> 6); // Skip faster through noise.
+				continue;
+			}
+			auto end = pos + minMatch;
+			for (auto ref = cand + minMatch;
+					 end < len - lastLiterals && src[end] == src[ref];
+					 ++end, ++ref)
+				;
+			while (pos > anchor && cand > 0 && src[pos - 1] == src[cand - 1])
+				--pos, --cand;
+
+			auto matchLen = end - pos - minMatch;
+			PutLiterals(out,
+									src + anchor,
+									pos - anchor,
+									static_cast<uint8_t>(std::min<size_t>(matchLen, 15)));
+			auto offset = pos - cand;
+			out.push_back(static_cast<uint8_t>(offset));
+			out.push_back(static_cast<uint8_t>(offset >> 8));
+			if (matchLen >= 15)
+				PutLength(out, matchLen - 15);
+			if (out.size() >= budget)
+				return false;
+
+			anchor = pos = end;
+			table[Hash(Read32(src + pos - 2))] = static_cast<uint32_t>(pos - 2);
+		}
+		PutLiterals(out, src + anchor, len - anchor, 0);
+		return out.size() < budget;
+	}
+
+	void DecompressLZ(const uint8_t* src, size_t len, uint8_t* dst, size_t cap) {
+		auto corrupt = [] {
+			throw std::runtime_error{"Corrupt compressed blob"};
+		};
+		size_t in = 0, out = 0;
+		auto getLength = [&](size_t base) {
+			if (base == 15)
+				for (uint8_t byte = 255; byte == 255; base += byte) {
+					if (in >= len) [[unlikely]]
+						corrupt();
+					byte = src[in++];
+				}
+			return base;
+		};
+		while (true) {
+			if (in >= len) [[unlikely]]
+				corrupt();
+			auto token		= src[in++];
+			auto literals = getLength(token >> 4);
+			if (literals > len - in || literals > cap - out) [[unlikely]]
+				corrupt();
+			std::memcpy(dst + out, src + in, literals);
+			in += literals;
+			out += literals;
+			if (in == len)
+				break;
+			if (len - in < 2) [[unlikely]]
+				corrupt();
+			size_t offset = src[in] | src[in + 1] << 8;
+			in += 2;
+			auto matchLen = getLength(token & 15) + minMatch;
+			if (offset == 0 || offset > out || matchLen > cap - out) [[unlikely]]
+				corrupt();
+			auto from = dst + out - offset;
+			if (offset >= matchLen)
+				std::memcpy(dst + out, from, matchLen);
+			else // Overlapping, repeats the last offset bytes.
+				for (size_t i = 0; i < matchLen; ++i)
+					dst[out + i] = from[i];
+			out += matchLen;
+		}
+		if (out != cap) [[unlikely]]
+			corrupt();
+	}
+} // namespace
+
+bool ZomboidHook::Encode(Codec codec,
+												 std::pair<const uint8_t*, size_t> src,
+												 std::vector<uint8_t>& out) {
+	out.clear();
+	switch (codec) {
+		case Codec::LZ:
+			return CompressLZ(src.first, src.second, out);
+		default:
+			return false;
+	}
+}
+
+void ZomboidHook::Decode(Codec codec,
+												 std::pair<const uint8_t*, size_t> src,
+												 uint8_t* dst,
+												 size_t len) {
+	switch (codec) {
+		case Codec::NONE:
+			if (src.second != len) [[unlikely]]
+				throw std::runtime_error{"Blob size mismatch"};
+			std::memcpy(dst, src.first, len);
+			break;
+		case Codec::LZ:
+			DecompressLZ(src.first, src.second, dst, len);
+			break;
+		default:
+			throw std::runtime_error{"Unknown blob codec"};
+	}
+}
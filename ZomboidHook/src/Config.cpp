@@ -0,0 +1,131 @@
+#include "Config.h"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+using namespace ZomboidHook;
+
+static std::string_view Env(const char* name) {
+	auto value = std::getenv(name);
+	return value ? value : "";
+}
+
+template <typename T>
+static void ParseNumber(const char* name, T& out) {
+	auto value = Env(name);
+	T parsed;
+	if (auto [end, ec] =
+					std::from_chars(value.data(), value.data() + value.size(), parsed);
+			ec == std::errc{} && end == value.data() + value.size())
+		out = parsed;
+}
+
+template <typename Duration>
+static void ParseDuration(const char* name, Duration& out) {
+	auto count = out.count();
+	ParseNumber(name, count);
+	out = Duration{count};
+}
+
+static void ParseDurability(const char* name, Durability& out) {
+	auto value = Env(name);
+	if (value == "off")
+		out = Durability::OFF;
+	else if (value == "group")
+		out = Durability::GROUP;
+	else if (value == "op")
+		out = Durability::PER_OP;
+	else if (value == "full")
+		out = Durability::FULL;
+}
+
+static void ParseSwitch(const char* name, bool& out) {
+	auto value = Env(name);
+	if (value == "on")
+		out = true;
+	else if (value == "off")
+		out = false;
+}
+
+static void ParseCodec(const char* name, Codec& out) {
+	auto value = Env(name);
+	if (value == "none")
+		out = Codec::NONE;
+	else if (value == "lz")
+		out = Codec::LZ;
+}
+
+// Off unless set, as the file outlives a process that does not exit cleanly.
+// "on" picks one file per process in the temp directory.
+static void ParseStats(const char* name, std::filesystem::path& out) {
+	auto value = Env(name);
+	if (value.empty())
+		return;
+	if (value == "off") {
+		out.clear();
+		return;
+	}
+	if (value != "on") {
+		out = value;
+		return;
+	}
+#ifdef _WIN32
+	auto pid = _getpid();
+#else
+	auto pid = getpid();
+#endif
+	std::error_code ec;
+	auto dir = std::filesystem::temp_directory_path(ec);
+	if (!ec)
+		out = dir / ("ZomboidDB-" + std::to_string(pid) + ".stats");
+}
+
+// Comma separated, and unlike the others an empty value is taken as is.
+static void ParseList(const char* name, std::vector<std::string>& out) {
+	auto value = std::getenv(name);
+	if (!value)
+		return;
+	out.clear();
+	std::string_view list{value};
+	while (!list.empty()) {
+		auto end = std::min(list.find(','), list.size());
+		if (end > 0)
+			out.emplace_back(list.substr(0, end));
+		list.remove_prefix(std::min(end + 1, list.size()));
+	}
+}
+
+Config Config::FromEnvironment() {
+	Config config;
+	ParseDurability("ZOMBOIDDB_DURABILITY", config.commit.durability);
+	ParseDuration("ZOMBOIDDB_COMMIT_WINDOW_MS", config.commit.window);
+	ParseNumber("ZOMBOIDDB_COMMIT_OPS", config.commit.maxOps);
+	ParseDuration("ZOMBOIDDB_COMMIT_IDLE_MS", config.commit.idleGap);
+	ParseSwitch("ZOMBOIDDB_WRITE_BEHIND", config.commit.writeBehind);
+	ParseNumber("ZOMBOIDDB_VACUUM_PAGES", config.commit.vacuumPages);
+	ParseCodec("ZOMBOIDDB_COMPRESSION", config.codec);
+	ParseNumber("ZOMBOIDDB_CACHE_MB", config.cacheMiB);
+	ParseNumber("ZOMBOIDDB_MMAP_MB", config.mmapMiB);
+	ParseSwitch("ZOMBOIDDB_SEGMENTS", config.segmented);
+	ParseNumber("ZOMBOIDDB_SHARDS", config.shards);
+	config.shards = std::clamp(config.shards, 1u, 64u);
+	ParseList("ZOMBOIDDB_INTERCEPT_EXTENSIONS", config.intercept.extensions);
+	ParseList("ZOMBOIDDB_INTERCEPT_PREFIXES", config.intercept.prefixes);
+	ParseDuration("ZOMBOIDDB_SNAPSHOT_MINUTES", config.snapshot.interval);
+	ParseNumber("ZOMBOIDDB_SNAPSHOT_KEEP", config.snapshot.keep);
+	if (auto dir = Env("ZOMBOIDDB_SNAPSHOT_DIR"); !dir.empty())
+		config.snapshot.dir = dir;
+	if (auto trace = Env("ZOMBOIDDB_TRACE"); !trace.empty())
+		config.trace = trace;
+	ParseStats("ZOMBOIDDB_STATS", config.stats);
+	return config;
+}
@@ -0,0 +1,71 @@
+#include "Hash.h"
+
+#include <bit>
+#include <cstring>
+
+using namespace ZomboidHook;
+
+namespace {
+	constexpr uint64_t c1 = 0x87c37b91114253d5;
+	constexpr uint64_t c2 = 0x4cf5ad432745937f;
+
+	uint64_t Read64(const uint8_t* p) noexcept {
+		uint64_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value; // The digest is only stable on little endian hosts.
+	}
+
+	uint64_t Mix1(uint64_t k) noexcept {
+		return std::rotl(k * c1, 31) * c2;
+	}
+
+	uint64_t Mix2(uint64_t k) noexcept {
+		return std::rotl(k * c2, 33) * c1;
+	}
+
+	uint64_t Finalize(uint64_t k) noexcept {
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccd;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53;
+		k ^= k >> 33;
+		return k;
+	}
+} // namespace
+
+std::pair<const uint8_t*, size_t> Digest::Data() const noexcept {
+	return {bytes.data(), bytes.size()};
+}
+
+Digest ZomboidHook::HashContent(std::pair<const uint8_t*, size_t> data,
+																uint32_t seed) noexcept {
+	auto [src, len] = data;
+	uint64_t h1 = seed, h2 = seed;
+	auto blocks = len / 16;
+	for (size_t i = 0; i < blocks; ++i, src += 16) {
+		h1 ^= Mix1(Read64(src));
+		h1 = (std::rotl(h1, 27) + h2) * 5 + 0x52dce729;
+		h2 ^= Mix2(Read64(src + 8));
+		h2 = (std::rotl(h2, 31) + h1) * 5 + 0x38495ab5;
+	}
+	if (auto tail = len % 16) {
+		uint8_t last[16]{};
+		std::memcpy(last, src, tail);
+		if (tail > 8)
+			h2 ^= Mix2(Read64(last + 8));
+		h1 ^= Mix1(Read64(last));
+	}
+	h1 ^= len;
+	h2 ^= len;
+	h1 += h2;
+	h2 += h1;
+	h1 = Finalize(h1);
+	h2 = Finalize(h2);
+	h1 += h2;
+	h2 += h1;
+
+	Digest digest;
+	std::memcpy(digest.bytes.data(), &h1, sizeof(h1));
+	std::memcpy(digest.bytes.data() + sizeof(h1), &h2, sizeof(h2));
+	return digest;
+}
@@ -0,0 +1,86 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <exception>
+#include <new>
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+static void StoreMax(std::atomic<uint64_t>& max, uint64_t value) noexcept {
+	auto seen = max.load(std::memory_order_relaxed);
+	while (seen < value &&
+				 !max.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+		;
+}
+
+static void Stamp(MetricsBlock& block) noexcept {
+	block.magic		= MetricsBlock::magicValue;
+	block.version = MetricsBlock::versionValue;
+	block.size		= sizeof(MetricsBlock);
+	block.started = std::chrono::system_clock::to_time_t(
+			std::chrono::system_clock::now());
+}
+
+void LatencyHistogram::Record(uint64_t ns, uint64_t len) noexcept {
+	count.fetch_add(1, std::memory_order_relaxed);
+	totalNs.fetch_add(ns, std::memory_order_relaxed);
+	bytes.fetch_add(len, std::memory_order_relaxed);
+	counts[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+	StoreMax(maxNs, ns);
+}
+
+Metrics::Timer::~Timer() {
+	Instance().Record(metric, Clock::now() - start, bytes);
+}
+
+Metrics& Metrics::Instance() noexcept {
+	static Metrics instance;
+	return instance;
+}
+
+Metrics::Metrics() noexcept {
+	Stamp(local);
+}
+
+bool Metrics::Export(IFileOps& fileOps, fs::path path) noexcept {
+	try {
+		auto file = fileOps.MapSharedFile(path, sizeof(MetricsBlock));
+		// Readers skip the file until the stamp is written, last.
+		auto shared = new (file->data()) MetricsBlock{};
+		Stamp(*shared);
+		exported	 = std::move(file);
+		exportPath = std::move(path);
+		block.store(shared, std::memory_order_release);
+		return true;
+	} catch (const std::exception&) {
+		return false;
+	}
+}
+
+void Metrics::Close() noexcept {
+	if (!exported)
+		return;
+	// Only called once the handler is gone, so nothing is counting into the
+	// mapping while it is unmapped.
+	block.store(&local, std::memory_order_release);
+	exported.reset();
+	std::error_code ec;
+	fs::remove(exportPath, ec);
+}
+
+MetricsBlock& Metrics::Block() noexcept {
+	return *block.load(std::memory_order_acquire);
+}
+
+void Metrics::Record(Metric metric,
+										 Clock::duration duration,
+										 uint64_t len) noexcept {
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration);
+	Block().ops[static_cast<size_t>(metric)].Record(
+			static_cast<uint64_t>(std::max<int64_t>(ns.count(), 0)), len);
+}
+
+Metrics::~Metrics() {
+	Close();
+}
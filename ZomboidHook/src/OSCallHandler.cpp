@@ -1,364 +1,395 @@
-#include "OSCallHandler.h"
-
-#include <cassert>
-
-namespace fs = std::filesystem;
-using namespace ZomboidHook;
-
-constexpr auto DBFILE = "ZomboidSQLite.db";
-
-bool OSCallHandler::ShouldIntercept(const fs::path& path) noexcept {
-	auto str = path.filename().string();
-	if (!str.ends_with(".bin"))
-		return false;
-	auto maybeSavesDir = path.parent_path().parent_path().parent_path();
-	if (!maybeSavesDir.has_parent_path()) [[unlikely]]
-		return false;
-	return /*(str.starts_with("chunkdata_") || str.starts_with("map_") ||
-						str.starts_with("zpop_")) &&*/
-			maybeSavesDir.filename().string() == "Saves" &&
-			fileOps.FileExists(path.parent_path());
-}
-
-bool OSCallHandler::ShouldIntercept(const FileInfo& info) noexcept {
-	return filePointers.contains(info.handle) || ShouldIntercept(info.path);
-}
-
-SaveDB::SaveDB(std::filesystem::path path) :
-		SQLite{
-				std::move(path),
-				"CREATE TABLE IF NOT EXISTS files (name TEXT PRIMARY KEY, data BLOB)"},
-		getBlobRowIDStmt{
-				PrepareStatement("SELECT rowid FROM files WHERE name = ?")},
-		blobExistsStmt{
-				PrepareStatement("SELECT COUNT(1) FROM files WHERE name = ?")},
-		upsertBlobStmt{PrepareStatement(
-				"INSERT OR REPLACE INTO files(name, data) VALUES(?1, ?2)")},
-		blobSizeStmt{
-				PrepareStatement("SELECT length(data) FROM files WHERE name = ?")},
-		truncateStmt{PrepareStatement(
-				"UPDATE files SET data = substr(data, ?1, ?2) WHERE name = ?3")},
-		deleteStmt{
-				PrepareStatement("UPDATE files SET data = NULL WHERE name = ?1")} {}
-
-size_t SaveDB::GetBlobRowIDStmt() const noexcept {
-	return getBlobRowIDStmt;
-}
-
-size_t SaveDB::BlobExistsStmt() const noexcept {
-	return blobExistsStmt;
-}
-
-size_t SaveDB::UpsertBlobStmt() const noexcept {
-	return upsertBlobStmt;
-}
-
-size_t SaveDB::BlobSizeStmt() const noexcept {
-	return blobSizeStmt;
-}
-
-size_t SaveDB::TruncateStmt() const noexcept {
-	return truncateStmt;
-}
-
-size_t SaveDB::DeleteStmt() const noexcept {
-	return deleteStmt;
-}
-
-void SaveDB::OnClosed() noexcept {
-	if (fs::is_empty(Path().parent_path()))
-		fs::remove(Path().parent_path());
-}
-
-OSCallHandler::OSCallHandler(IFileOps& fileOps) : fileOps{fileOps} {}
-
-bool OSCallHandler::BlobExists(SaveDB& db, const fs::path& path) {
-	return db[db.BlobExistsStmt()].Execute([&](bool exists) { return exists; },
-																				 path.filename().string());
-}
-
-bool OSCallHandler::BlobExists(SaveDB& db, const FileInfo& info) {
-	return BlobExists(db, info.path);
-}
-
-static int BlobSize(SaveDB& db, const FileInfo& info) {
-	return db[db.BlobSizeStmt()].Execute([](int len) { return len; },
-																			 info.path.filename().string());
-}
-
-SaveDB& OSCallHandler::GetDBInstance(const fs::path& path) {
-	auto parent = path.parent_path();
-	return databases.try_emplace(parent.string(), parent / DBFILE).first->second;
-}
-
-SaveDB& OSCallHandler::GetDBInstance(const FileInfo& info) {
-	return GetDBInstance(info.path);
-}
-
-FileIntent OSCallHandler::FileOpenOnly(FileInfo info) {
-	if (!ShouldIntercept(info))
-		return FileIntent::PASSTHRU;
-	auto& db = GetDBInstance(info);
-	if (BlobExists(db, info)) {
-		filePointers[info.handle] = 0;
-		return FileIntent::SUCCEED;
-	}
-	if (fileOps.FileExists(info.path)) {
-		auto mmap = fileOps.MemMapFile(info.path);
-		db[db.UpsertBlobStmt()].Execute(info.path.filename().string(),
-																		std::make_pair(mmap->data(), mmap->size()));
-		filePointers[info.handle] = 0;
-		return FileIntent::SUCCEED;
-	}
-	return FileIntent::PASSTHRU;
-}
-
-FileIntent OSCallHandler::FileCreateOnly(FileInfo info) {
-	if (!ShouldIntercept(info))
-		return FileIntent::PASSTHRU;
-	auto& db = GetDBInstance(info);
-	if (BlobExists(db, info))
-		return FileIntent::FAIL;
-	if (fileOps.FileExists(
-					info.path)) { // Make an internal copy anyway before we fail it.
-		auto mmap = fileOps.MemMapFile(info.path);
-		db[db.UpsertBlobStmt()].Execute(info.path.filename().string(),
-																		std::make_pair(mmap->data(), mmap->size()));
-		return FileIntent::FAIL;
-	}
-	return FileIntent::SUCCEED;
-}
-
-FileIntent OSCallHandler::FileOpenOrCreate(FileInfo info) {
-	if (!ShouldIntercept(info))
-		return FileIntent::PASSTHRU;
-	auto& db = GetDBInstance(info);
-	if (BlobExists(db, info))
-		return FileIntent::SUCCEED;
-	if (fileOps.FileExists(info.path)) {
-		auto mmap = fileOps.MemMapFile(info.path);
-		db[db.UpsertBlobStmt()].Execute(info.path.filename().string(),
-																		std::make_pair(mmap->data(), mmap->size()));
-		filePointers[info.handle] = 0;
-	}
-	return FileIntent::SUCCEED;
-}
-
-FileIntent OSCallHandler::FileCreateAndWipe(FileInfo info) {
-	if (!ShouldIntercept(info))
-		return FileIntent::PASSTHRU;
-	auto& db = GetDBInstance(info);
-	if (BlobExists(db, info))
-		db[db.DeleteStmt()].Execute(info.path.filename().string());
-	return FileIntent::SUCCEED;
-}
-
-FileIntent OSCallHandler::FileOpenOnlyAndWipe(FileInfo info) {
-	if (!ShouldIntercept(info))
-		return FileIntent::PASSTHRU;
-	auto& db = GetDBInstance(info);
-	if (BlobExists(db, info)) {
-		db[db.DeleteStmt()].Execute(info.path.filename().string());
-		return FileIntent::SUCCEED;
-	}
-	return FileIntent::FAIL;
-}
-
-FileIntent
-		OSCallHandler::FileRead(FileInfo info, uint8_t* buf, uint32_t& readLen) {
-	auto& db = GetDBInstance(info);
-	if (!BlobExists(db, info)) [[unlikely]]
-		return FileIntent::FAIL;
-	return db[db.GetBlobRowIDStmt()].Execute(
-			[&](std::optional<int64_t> rowid) {
-				if (!rowid)
-					return FileIntent::FAIL;
-				SQLBlob blob{db, SaveDB::table, SaveDB::dataCol, *rowid};
-				auto len	= blob.Size();
-				auto& ptr = filePointers[info.handle];
-				if (readLen > len - ptr) [[unlikely]]
-					readLen = len - ptr;
-				blob.Read(buf, ptr, readLen);
-				ptr += readLen;
-				return FileIntent::SUCCEED;
-			},
-			info.path.filename().string());
-
-	/*db[db.GetBlobStmt()].Execute([&] (std::pair<const uint8_t*, size_t> blob) {
-			auto [data, len] = blob;
-			auto& ptr = filePointers[info.handle];
-			if (readLen > len - ptr)
-					readLen = len - ptr;
-			std::copy(data + ptr, data + ptr + readLen, buf);
-			ptr += readLen;
-			ret = FileIntent::SUCCEED;
-	}, info.path.filename().string());
-	return ret;*/
-}
-
-FileIntent OSCallHandler::FileWrite(FileInfo info,
-																		const uint8_t* buf,
-																		uint32_t& writeLen) {
-	auto& db	= GetDBInstance(info);
-	auto& ptr = filePointers[info.handle];
-	if (BlobExists(db, info)) {
-		if (ptr > 0 || BlobSize(db, info) > 0) {
-			db[db.GetBlobRowIDStmt()].Execute(
-					[&](int64_t rowid) {
-						SQLBlob blob{db, SaveDB::table, SaveDB::dataCol, rowid};
-						auto len = blob.Size();
-						if (len - ptr < writeLen) {
-							auto origData = std::make_unique<uint8_t[]>(len);
-							blob.Read(origData.get(), 0, len);
-							db[db.UpsertBlobStmt()].Execute(info.path.filename().string(),
-																							ZeroBlob{writeLen + ptr});
-							blob.Reopen(db.LastInsertRowID());
-							blob.Write(std::make_pair(origData.get(), len), 0);
-						}
-						blob.Write(std::make_pair(buf, writeLen), ptr);
-						ptr += writeLen;
-					},
-					info.path.filename().string());
-			return FileIntent::SUCCEED;
-		}
-	}
-	db[db.UpsertBlobStmt()].Execute(info.path.filename().string(),
-																	std::make_pair(buf, writeLen));
-	ptr += writeLen;
-	return FileIntent::SUCCEED;
-
-	/*if (BlobExists(db, info))
-			db[db.GetBlobStmt()].Execute([&] (std::pair<const uint8_t*, size_t> blob)
-	{ auto [data, len] = blob; auto& ptr = filePointers[info.handle]; auto
-	tmpBufLen = len - ptr < writeLen ? writeLen + ptr : len; auto tmp =
-	std::make_unique<uint8_t[]>(tmpBufLen); std::copy(data, data + len,
-	tmp.get()); std::copy(buf, buf + writeLen, tmp.get() + ptr);
-					db[db.UpsertBlobStmt()].Execute(info.path.filename().string(),
-	std::make_pair(tmp.get(), tmpBufLen)); ptr += writeLen;
-			}, info.path.filename().string());
-	else
-			db[db.UpsertBlobStmt()].Execute(info.path.filename().string(),
-	std::make_pair(buf, writeLen)); return FileIntent::SUCCEED;*/
-}
-
-FileIntent
-		OSCallHandler::FileSeek(FileInfo info, SeekFrom pos, int64_t& distance) {
-	auto& ptr = filePointers[info.handle];
-	switch (pos) {
-		case SeekFrom::CURRENT:
-			ptr += distance;
-			break;
-		case SeekFrom::BEGIN:
-			ptr = distance;
-			break;
-		case SeekFrom::END:
-			{
-				auto& db = GetDBInstance(info);
-				db[db.BlobSizeStmt()].Execute([&](int len) { ptr = len + distance; },
-																			info.path.filename().string());
-			}
-	}
-	distance = ptr;
-	return FileIntent::SUCCEED;
-}
-
-FileIntent OSCallHandler::FileTruncateToCursor(FileInfo info) {
-	if (auto ptr = filePointers[info.handle]; ptr == 0)
-		return FileTruncate(info, 0);
-	auto& db							= GetDBInstance(info);
-	constexpr auto offset = 0;
-	db[db.TruncateStmt()].Execute(offset,
-																filePointers[info.handle],
-																info.path.filename().string());
-	return FileIntent::SUCCEED;
-}
-
-FileIntent OSCallHandler::FileTruncate(FileInfo info, uint64_t len) {
-	assert(len <= std::numeric_limits<int64_t>::max());
-	auto& db							= GetDBInstance(info);
-	constexpr auto offset = 0;
-	if (len == 0)
-		db[db.DeleteStmt()].Execute(info.path.filename().string());
-	else
-		db[db.GetBlobRowIDStmt()].Execute(
-				[&](int64_t rowid) {
-					SQLBlob blob{db, SaveDB::table, SaveDB::dataCol, rowid};
-					auto blobSize = blob.Size();
-					if (len < blobSize)
-						db[db.TruncateStmt()].Execute(offset,
-																					filePointers[info.handle],
-																					info.path.filename().string());
-					else if (len > blobSize) {
-						auto currentData = std::make_unique<uint8_t[]>(blobSize);
-						blob.Read(currentData.get(), 0, blobSize);
-						db[db.UpsertBlobStmt()].Execute(
-								info.path.filename().string(),
-								ZeroBlob{static_cast<int64_t>(len)});
-						blob.Reopen(db.LastInsertRowID());
-						blob.Write(std::make_pair(currentData.get(), blobSize), offset);
-					}
-				},
-				info.path.filename().string());
-	return FileIntent::SUCCEED;
-
-	/*db[db.GetBlobStmt()].Execute([&] (std::pair<const uint8_t*, size_t> blob) {
-			auto [data, size] = blob;
-			if (len < size)
-					db[db.UpsertBlobStmt()].Execute(std::make_pair(data, len));
-			else if (len > size){
-					auto tmpBuf = std::make_unique<uint8_t[]>(len);
-					std::copy(data, data + size, tmpBuf.get());
-					db[db.UpsertBlobStmt()].Execute(std::make_pair(data, len));
-			}
-	}, info.path.filename().string());
-	return FileIntent::SUCCEED;*/
-}
-
-FileIntent OSCallHandler::FileDelete(const std::filesystem::path& path) {
-	if (ShouldIntercept(path)) {
-		auto& db = GetDBInstance(path);
-		db[db.DeleteStmt()].Execute(path.filename().string());
-		return db.RowsChanged() != 0 ? FileIntent::SUCCEED : FileIntent::FAIL;
-	}
-	return FileIntent::PASSTHRU;
-}
-
-FileIntent OSCallHandler::FileSetAttrib(const std::filesystem::path& path) {
-	return ShouldIntercept(path) ? FileIntent::SUCCEED : FileIntent::PASSTHRU;
-}
-
-FileIntent OSCallHandler::FileGetSize(FileInfo info,
-																			uint64_t& sizeOut,
-																			bool isStateless) {
-	if (isStateless && !ShouldIntercept(info))
-		return FileIntent::PASSTHRU;
-	auto& db = GetDBInstance(info);
-	db[db.BlobSizeStmt()].Execute([&](int size) { sizeOut = size; },
-																info.path.filename().string());
-	return FileIntent::SUCCEED;
-}
-
-FileAttribute OSCallHandler::FileGetAttrib(const fs::path& path) {
-	if (!ShouldIntercept(path))
-		return FileAttribute::PASSTHRU;
-	auto& db = GetDBInstance(path);
-	if (BlobExists(db, path))
-		return FileAttribute::NORMAL;
-	if (fileOps.FileExists(path)) {
-		auto mmap = fileOps.MemMapFile(path);
-		db[db.UpsertBlobStmt()].Execute(path.filename().string(),
-																		std::make_pair(mmap->data(), mmap->size()));
-		return FileAttribute::NORMAL;
-	}
-	return FileAttribute::NOT_FOUND;
-}
-
-FileTimes OSCallHandler::FileGetTimes(const std::filesystem::path& path) {
-	auto& db		= GetDBInstance(path);
-	auto dbFile = db.Path();
-	return fileOps.GetFileTimes(path);
-}
-
-void OSCallHandler::FileClosed(FileInfo info) {
-	filePointers.erase(info.handle);
-}
+#include "OSCallHandler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include "Metrics.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+bool OSCallHandler::ShouldIntercept(const fs::path& path) noexcept {
+	return router.ShouldIntercept(path.native());
+}
+
+bool OSCallHandler::ShouldIntercept(const FileInfo& info) noexcept {
+	return openFiles.Contains(info.handle) || ShouldIntercept(info.path);
+}
+
+OSCallHandler::OSCallHandler(IFileOps& fileOps, Config config) :
+		router{fileOps, std::move(config)}, fileOps{fileOps} {}
+
+bool OSCallHandler::MayIntercept(PathView path) const noexcept {
+	return router.MatchesName(path);
+}
+
+bool OSCallHandler::BlobExists(SaveDB& db, const fs::path& path) {
+	return db.Exists(path.filename().string());
+}
+
+bool OSCallHandler::BlobExists(SaveDB& db, const FileInfo& info) {
+	return BlobExists(db, info.path);
+}
+
+bool OSCallHandler::OnDisk(SaveDB& db, const fs::path& path) {
+	auto name = path.filename().string();
+	if (db.KnownMissing(name)) [[likely]]
+		return false;
+	if (fileOps.FileExists(path))
+		return true;
+	db.MarkMissing(name);
+	return false;
+}
+
+SaveDB& OSCallHandler::GetDBInstance(const fs::path& path) {
+	return router.Database(path.native());
+}
+
+SaveDB& OSCallHandler::GetDBInstance(const FileInfo& info) {
+	return GetDBInstance(info.path);
+}
+
+HandleRegistry<OpenFile>::Ref
+		OSCallHandler::GetOpenFile(const FileInfo& info) {
+	if (auto file = openFiles.Find(info.handle)) [[likely]]
+		return file;
+	return openFiles.Emplace(info.handle, GetDBInstance(info), info.path);
+}
+
+void OSCallHandler::Migrate(SaveDB& db, const fs::path& path) {
+	Metrics::Timer timer{Metric::MIGRATE};
+	auto name			= path.filename().string();
+	auto mmap			= fileOps.MemMapFile(path);
+	auto mutation = db.Mutate();
+	timer.bytes		= mmap->size();
+	db.PutBlob(name, {mmap->data(), mmap->size()});
+}
+
+static fs::path::string_type DirtyKey(const fs::path& path) {
+	return PathRouter::Key(path.native());
+}
+
+void OSCallHandler::MarkDirty(const FileInfo& info) {
+	std::lock_guard lock{dirtyMutex};
+	auto& handles = dirtyHandles[DirtyKey(info.path)];
+	if (std::find(handles.begin(), handles.end(), info.handle) ==
+			handles.end()) {
+		handles.push_back(info.handle);
+		dirtyCount.fetch_add(1, std::memory_order_release);
+	}
+}
+
+void OSCallHandler::Unlist(int64_t handle,
+													 const fs::path::string_type& key) noexcept {
+	if (dirtyCount.load(std::memory_order_acquire) == 0) [[likely]]
+		return;
+	std::lock_guard lock{dirtyMutex};
+	if (auto found = dirtyHandles.find(key); found != dirtyHandles.end()) {
+		dirtyCount.fetch_sub(std::erase(found->second, handle),
+												 std::memory_order_release);
+		if (found->second.empty())
+			dirtyHandles.erase(found);
+	}
+}
+
+void OSCallHandler::Forget(const FileInfo& info) {
+	auto key = DirtyKey(info.path);
+	openFiles.Erase(info.handle);
+	Unlist(info.handle, key);
+}
+
+template <typename Fn>
+FileIntent OSCallHandler::Opening(const FileInfo& info, Fn&& fn) {
+	FileIntent intent;
+	try {
+		intent = fn();
+	} catch (...) {
+		Forget(info);
+		throw;
+	}
+	if (intent != FileIntent::SUCCEED)
+		Forget(info);
+	return intent;
+}
+
+template <typename Fn>
+void OSCallHandler::Modify(const FileInfo& info, Fn&& fn) {
+	auto file	 = GetOpenFile(info);
+	auto dirty = file->Dirty();
+	fn(*file);
+	if (!dirty && file->Dirty())
+		MarkDirty(info);
+}
+
+void OSCallHandler::FlushWrites(const fs::path& path) {
+	if (dirtyCount.load(std::memory_order_acquire) == 0) [[likely]]
+		return;
+	std::vector<int64_t> handles;
+	{
+		std::lock_guard lock{dirtyMutex};
+		auto found = dirtyHandles.find(DirtyKey(path));
+		if (found == dirtyHandles.end())
+			return;
+		handles = std::move(found->second);
+		dirtyHandles.erase(found);
+		dirtyCount.fetch_sub(handles.size(), std::memory_order_release);
+	}
+	// A handle written again meanwhile is listed anew, as it was flushed here
+	// and is clean until then.
+	for (auto handle : handles)
+		if (auto file = openFiles.Find(handle))
+			file->Flush();
+}
+
+FileIntent OSCallHandler::FileOpenOnly(FileInfo info) {
+	Metrics::Timer timer{Metric::OPEN_ONLY};
+	if (!ShouldIntercept(info))
+		return FileIntent::PASSTHRU;
+	FlushWrites(info.path);
+	return Opening(info, [&] {
+		if (GetOpenFile(info)->Exists())
+			return FileIntent::SUCCEED;
+		if (auto& db = GetDBInstance(info); OnDisk(db, info.path)) {
+			Migrate(db, info.path);
+			return FileIntent::SUCCEED;
+		}
+		return FileIntent::PASSTHRU;
+	});
+}
+
+FileIntent OSCallHandler::FileCreateOnly(FileInfo info) {
+	Metrics::Timer timer{Metric::CREATE_ONLY};
+	if (!ShouldIntercept(info))
+		return FileIntent::PASSTHRU;
+	FlushWrites(info.path);
+	return Opening(info, [&] {
+		auto& db = GetDBInstance(info);
+		if (BlobExists(db, info))
+			return FileIntent::FAIL;
+		if (OnDisk(db, info.path)) { // Make an internal copy anyway, then fail.
+			Migrate(db, info.path);
+			return FileIntent::FAIL;
+		}
+		GetOpenFile(info)->Wipe(); // The row is created when the handle closes.
+		MarkDirty(info);
+		return FileIntent::SUCCEED;
+	});
+}
+
+FileIntent OSCallHandler::FileOpenOrCreate(FileInfo info) {
+	Metrics::Timer timer{Metric::OPEN_OR_CREATE};
+	if (!ShouldIntercept(info))
+		return FileIntent::PASSTHRU;
+	FlushWrites(info.path);
+	return Opening(info, [&] {
+		auto file = GetOpenFile(info);
+		if (file->Exists())
+			return FileIntent::SUCCEED;
+		if (auto& db = GetDBInstance(info); OnDisk(db, info.path))
+			Migrate(db, info.path);
+		else {
+			file->Wipe();
+			MarkDirty(info);
+		}
+		return FileIntent::SUCCEED;
+	});
+}
+
+FileIntent OSCallHandler::FileCreateAndWipe(FileInfo info) {
+	Metrics::Timer timer{Metric::CREATE_AND_WIPE};
+	if (!ShouldIntercept(info))
+		return FileIntent::PASSTHRU;
+	FlushWrites(info.path);
+	return Opening(info, [&] {
+		GetOpenFile(info)->Wipe(); // Replaces any existing data on close.
+		MarkDirty(info);
+		return FileIntent::SUCCEED;
+	});
+}
+
+FileIntent OSCallHandler::FileOpenOnlyAndWipe(FileInfo info) {
+	Metrics::Timer timer{Metric::OPEN_ONLY_AND_WIPE};
+	if (!ShouldIntercept(info))
+		return FileIntent::PASSTHRU;
+	FlushWrites(info.path);
+	return Opening(info, [&] {
+		if (auto file = GetOpenFile(info);
+				file->Exists() || OnDisk(GetDBInstance(info), info.path)) {
+			file->Wipe();
+			MarkDirty(info);
+			return FileIntent::SUCCEED;
+		}
+		return FileIntent::FAIL;
+	});
+}
+
+FileIntent
+		OSCallHandler::FileRead(FileInfo info, uint8_t* buf, uint32_t& readLen) {
+	Metrics::Timer timer{Metric::READ};
+	if (!GetOpenFile(info)->Read(buf, readLen)) [[unlikely]]
+		return FileIntent::FAIL;
+	timer.bytes = readLen;
+	return FileIntent::SUCCEED;
+}
+
+FileIntent OSCallHandler::FileWrite(FileInfo info,
+																		const uint8_t* buf,
+																		uint32_t& writeLen) {
+	Metrics::Timer timer{Metric::WRITE};
+	Modify(info, [&](OpenFile& file) { file.Write(buf, writeLen); });
+	timer.bytes = writeLen;
+	Metrics::Instance().Block().bytesRequested.fetch_add(
+			writeLen, std::memory_order_relaxed);
+	return FileIntent::SUCCEED;
+}
+
+FileIntent OSCallHandler::FileReadAt(FileInfo info,
+																		 uint8_t* buf,
+																		 uint32_t& readLen,
+																		 uint64_t offset) {
+	Metrics::Timer timer{Metric::READ};
+	if (!GetOpenFile(info)->ReadAt(buf, readLen, offset)) [[unlikely]]
+		return FileIntent::FAIL;
+	timer.bytes = readLen;
+	return FileIntent::SUCCEED;
+}
+
+FileIntent OSCallHandler::FileWriteAt(FileInfo info,
+																			const uint8_t* buf,
+																			uint32_t& writeLen,
+																			uint64_t offset) {
+	Metrics::Timer timer{Metric::WRITE};
+	Modify(info, [&](OpenFile& file) { file.WriteAt(buf, writeLen, offset); });
+	timer.bytes = writeLen;
+	Metrics::Instance().Block().bytesRequested.fetch_add(
+			writeLen, std::memory_order_relaxed);
+	return FileIntent::SUCCEED;
+}
+
+FileIntent OSCallHandler::FileAppend(FileInfo info,
+																		 const uint8_t* buf,
+																		 uint32_t& writeLen) {
+	Metrics::Timer timer{Metric::WRITE};
+	Modify(info, [&](OpenFile& file) { file.Append(buf, writeLen); });
+	timer.bytes = writeLen;
+	Metrics::Instance().Block().bytesRequested.fetch_add(
+			writeLen, std::memory_order_relaxed);
+	return FileIntent::SUCCEED;
+}
+
+// Commits as well, which is as durable as the configured durability gets.
+FileIntent OSCallHandler::FileFlush(FileInfo info) {
+	Metrics::Timer timer{Metric::FLUSH};
+	GetOpenFile(info)->Flush();
+	auto& db = GetDBInstance(info);
+	db.Drain();
+	db.Commit();
+	return FileIntent::SUCCEED;
+}
+
+FileIntent
+		OSCallHandler::FileSeek(FileInfo info, SeekFrom pos, int64_t& distance) {
+	Metrics::Timer timer{Metric::SEEK};
+	distance = GetOpenFile(info)->Seek(pos, distance);
+	return FileIntent::SUCCEED;
+}
+
+FileIntent OSCallHandler::FileTruncateToCursor(FileInfo info) {
+	Metrics::Timer timer{Metric::TRUNCATE_TO_CURSOR};
+	Modify(info, [](OpenFile& file) { file.TruncateToCursor(); });
+	return FileIntent::SUCCEED;
+}
+
+FileIntent OSCallHandler::FileTruncate(FileInfo info, uint64_t len) {
+	Metrics::Timer timer{Metric::TRUNCATE};
+	assert(len <= std::numeric_limits<int64_t>::max());
+	Modify(info, [&](OpenFile& file) { file.Truncate(len); });
+	return FileIntent::SUCCEED;
+}
+
+FileIntent OSCallHandler::FileDelete(const std::filesystem::path& path) {
+	Metrics::Timer timer{Metric::DELETE};
+	if (ShouldIntercept(path)) {
+		FlushWrites(path);
+		auto name = path.filename().string();
+		auto& db	= GetDBInstance(path);
+		return db.Remove(name) ? FileIntent::SUCCEED : FileIntent::FAIL;
+	}
+	return FileIntent::PASSTHRU;
+}
+
+FileIntent OSCallHandler::FileSetAttrib(const std::filesystem::path& path) {
+	Metrics::Timer timer{Metric::SET_ATTRIB};
+	return ShouldIntercept(path) ? FileIntent::SUCCEED : FileIntent::PASSTHRU;
+}
+
+FileIntent OSCallHandler::FileGetSize(FileInfo info,
+																			uint64_t& sizeOut,
+																			bool isStateless) {
+	Metrics::Timer timer{Metric::GET_SIZE};
+	if (!isStateless) {
+		sizeOut = GetOpenFile(info)->Size();
+		return FileIntent::SUCCEED;
+	}
+	if (!ShouldIntercept(info))
+		return FileIntent::PASSTHRU;
+	FlushWrites(info.path);
+	auto name = info.path.filename().string();
+	sizeOut		= GetDBInstance(info).Size(name);
+	return FileIntent::SUCCEED;
+}
+
+FileAttribute OSCallHandler::FileGetAttrib(const fs::path& path) {
+	Metrics::Timer timer{Metric::GET_ATTRIB};
+	if (!ShouldIntercept(path))
+		return FileAttribute::PASSTHRU;
+	FlushWrites(path);
+	auto& db = GetDBInstance(path);
+	if (BlobExists(db, path))
+		return FileAttribute::NORMAL;
+	if (OnDisk(db, path)) {
+		Migrate(db, path);
+		return FileAttribute::NORMAL;
+	}
+	return FileAttribute::NOT_FOUND;
+}
+
+FileTimes OSCallHandler::FileGetTimes(const std::filesystem::path& path) {
+	Metrics::Timer timer{Metric::GET_TIMES};
+	return fileOps.GetFileTimes(path);
+}
+
+void OSCallHandler::FileClosed(FileInfo info) {
+	Metrics::Timer timer{Metric::CLOSED};
+	auto file = openFiles.Find(info.handle);
+	if (!file)
+		return;
+	// Forgets the handle even if the flush throws, as the frontend releases it
+	// either way and the number is up for reuse.
+	struct Forget {
+		OSCallHandler& handler;
+		HandleRegistry<OpenFile>::Ref& file;
+		int64_t handle;
+		fs::path::string_type key;
+
+		~Forget() {
+			file.Erase();
+			handler.Unlist(handle, key);
+		}
+	} forget{*this, file, info.handle, {}};
+	// Only this thread can list the handle, so it is not listed while none are.
+	if (dirtyCount.load(std::memory_order_acquire) > 0)
+		forget.key = DirtyKey(file->Path());
+	file->Flush();
+}
+
+OSCallHandler::~OSCallHandler() {
+	openFiles.ForEach([](OpenFile& file) {
+		try {
+			file.Flush();
+		} catch (const std::exception&) {
+			// Nothing is left to report to, so writes that fail here are lost.
+		}
+	});
+}
@@ -0,0 +1,256 @@
+#include "OpenFile.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "BlobCache.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+OpenFile::OpenFile(SaveDB& db, const fs::path& path) :
+		db{db}, path{path}, name{path.filename().string()} {
+	Resolve();
+}
+
+void OpenFile::Resolve() {
+	segments.clear();
+	unpackedIndex.reset();
+	seenChanges = db.Changes();
+	whole				= db.Queued(name);
+	auto stat		= whole ? BlobStat{0, whole->size()} : db.Stat(name);
+	rowID				= stat.rowID;
+	size				= stat.size;
+	codec				= stat.codec;
+}
+
+void OpenFile::Refresh() {
+	if (seenChanges != db.Changes()) [[unlikely]]
+		Resolve();
+}
+
+void OpenFile::ReadBlob(uint8_t* buf, uint64_t offset, uint32_t len) {
+	Borrowed borrowed;
+	auto& reader = borrowed.reader;
+	if (!whole) {
+		// Files that can be cached are loaded whole, to be read later without
+		// SQLite. Any other file read in one go skips opening a blob, and if
+		// packed is unpacked straight into buf.
+		auto cacheable = BlobCache::Instance().Fits(size);
+		if (!cacheable && offset == 0 && len == size &&
+				db.ReadWhole(name, reader, buf, len))
+			return;
+		// Segmented files read only the segments in range, other packed blobs
+		// cannot be read in part and are unpacked whole too.
+		if (!cacheable && codec == Codec::SEGMENTS) {
+			ReadSegments(borrowed, buf, offset, len);
+			return;
+		}
+		if (cacheable || codec != Codec::NONE)
+			if (whole = db.LoadWhole(name, reader); !whole) [[unlikely]]
+				throw std::runtime_error{"Failed to read blob"};
+	}
+	if (whole) {
+		if (offset + len > whole->size()) [[unlikely]]
+			throw std::runtime_error{"Failed to read blob"};
+		std::copy_n(whole->data() + offset, len, buf);
+		return;
+	}
+	ReadRow(borrowed, *rowID, buf, offset, len);
+}
+
+void OpenFile::ReadSegments(Borrowed& borrowed,
+														uint8_t* buf,
+														uint64_t offset,
+														uint32_t len) {
+	auto& reader = borrowed.reader;
+	if (segments.empty())
+		segments = db.Segments(name, reader);
+	// Segments all have the size of the first but for the last.
+	auto index = segments.empty() ? 0 : offset / segments[0].size;
+	for (; len > 0; ++index) {
+		if (index >= segments.size()) [[unlikely]]
+			throw std::runtime_error{"Failed to read blob"};
+		auto& segment = segments[index];
+		auto within		= offset - segment.offset;
+		auto count		= static_cast<uint32_t>(
+				 std::min<uint64_t>(len, segment.size - within));
+		if (segment.codec == Codec::NONE)
+			ReadRow(borrowed, segment.rowID, buf, within, count);
+		else {
+			if (unpackedIndex != index) {
+				db.LoadSegment(name, segment, reader, unpackedSegment);
+				unpackedIndex = index;
+			}
+			std::copy_n(unpackedSegment.data() + within, count, buf);
+		}
+		buf += count;
+		offset += count;
+		len -= count;
+	}
+}
+
+void OpenFile::ReadRow(Borrowed& borrowed,
+											 int64_t row,
+											 uint8_t* buf,
+											 uint64_t offset,
+											 uint32_t len) {
+	auto& session = db.ReadSession(name, borrowed.reader);
+	auto& blob		= borrowed.blob;
+	if (!blob || borrowed.blobSession != &session) {
+		blob.reset();
+		blob.emplace(session, SaveDB::table, SaveDB::dataCol, row, false);
+		borrowed.blobSession = &session;
+		borrowed.blobRow		 = row;
+	} else if (borrowed.blobRow != row) {
+		blob->Reopen(row);
+		borrowed.blobRow = row;
+	}
+	blob->Read(buf, offset, len);
+}
+
+WriteBuffer& OpenFile::Buffer(uint64_t from, bool load) {
+	SaveDB::ReaderLease reader;
+	if (pending && from < pending->Base()) [[unlikely]] {
+		// Writing into the kept segments after all, which are loaded now.
+		std::vector<uint8_t> head, part;
+		for (auto& segment : kept) {
+			db.LoadSegment(name, segment, reader, part);
+			head.insert(head.end(), part.begin(), part.end());
+		}
+		pending->Prepend(head);
+		kept.clear();
+	}
+	if (pending)
+		return *pending;
+	pending.emplace();
+	if (!load)
+		return *pending;
+	Refresh();
+	if (whole) {
+		pending->Assign(std::vector<uint8_t>{*whole});
+		return *pending;
+	}
+	// Queued files are never segmented, and the queue only takes whole files.
+	if (codec == Codec::SEGMENTS && !db.Policy().writeBehind) {
+		if (segments.empty())
+			segments = db.Segments(name, reader);
+		size_t keep = 0;
+		while (keep < segments.size() &&
+					 segments[keep].size == SaveDB::segmentSize &&
+					 segments[keep].offset + segments[keep].size <= from)
+			++keep;
+		if (keep > 0) {
+			std::vector<uint8_t> data, part;
+			for (auto i = keep; i < segments.size(); ++i) {
+				db.LoadSegment(name, segments[i], reader, part);
+				data.insert(data.end(), part.begin(), part.end());
+			}
+			kept.assign(segments.begin(), segments.begin() + keep);
+			pending->Assign(std::move(data), keep * uint64_t{SaveDB::segmentSize});
+			return *pending;
+		}
+	}
+	std::vector<uint8_t> data;
+	db.LoadBlob(name, reader, data);
+	pending->Assign(std::move(data));
+	return *pending;
+}
+
+bool OpenFile::Exists() {
+	if (pending)
+		return true;
+	Refresh();
+	return rowID.has_value();
+}
+
+bool OpenFile::Read(uint8_t* buf, uint32_t& len) {
+	// A cursor before the start reads nothing, just as one past the end.
+	if (!ReadAt(buf, len, static_cast<uint64_t>(cursor))) [[unlikely]]
+		return false;
+	cursor += len;
+	return true;
+}
+
+void OpenFile::Write(const uint8_t* buf, uint32_t len) {
+	WriteAt(buf, len, cursor);
+	cursor += len;
+}
+
+bool OpenFile::ReadAt(uint8_t* buf, uint32_t& len, uint64_t offset) {
+	Flush();
+	Refresh();
+	if (!rowID) [[unlikely]]
+		return false;
+	if (offset >= size) {
+		len = 0;
+		return true;
+	}
+	len = static_cast<uint32_t>(std::min<uint64_t>(len, size - offset));
+	if (len > 0)
+		ReadBlob(buf, offset, len);
+	return true;
+}
+
+void OpenFile::WriteAt(const uint8_t* buf, uint32_t len, uint64_t offset) {
+	Buffer(offset).Write(buf, len, offset);
+}
+
+void OpenFile::Append(const uint8_t* buf, uint32_t len) {
+	cursor = Size();
+	Write(buf, len);
+}
+
+int64_t OpenFile::Seek(SeekFrom from, int64_t distance) {
+	switch (from) {
+		case SeekFrom::CURRENT:
+			cursor += distance;
+			break;
+		case SeekFrom::BEGIN:
+			cursor = distance;
+			break;
+		case SeekFrom::END:
+			cursor = Size() + distance;
+			break;
+	}
+	return cursor;
+}
+
+void OpenFile::Truncate(uint64_t len) {
+	Buffer(len, len > 0).Resize(len); // Only the bytes kept need loading.
+}
+
+void OpenFile::TruncateToCursor() {
+	Truncate(cursor);
+}
+
+void OpenFile::Wipe() {
+	pending.emplace();
+	kept.clear();
+}
+
+void OpenFile::Flush() {
+	if (!pending)
+		return;
+	if (kept.empty())
+		db.Store(name, pending->Bytes());
+	else
+		db.Store(name, kept, pending->Bytes());
+	pending.reset();
+	kept.clear();
+}
+
+bool OpenFile::Dirty() const noexcept {
+	return pending.has_value();
+}
+
+uint64_t OpenFile::Size() {
+	if (pending)
+		return pending->Size();
+	Refresh();
+	return size;
+}
+
+const fs::path& OpenFile::Path() const noexcept {
+	return path;
+}
@@ -0,0 +1,161 @@
+#include "PathRouter.h"
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "BlobCache.h"
+#include "Shards.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+namespace {
+	bool IsSeparator(PathView::value_type c) noexcept {
+		return c == '/' || c == fs::path::preferred_separator;
+	}
+
+	// Splits off the last component, which is empty for a trailing separator.
+	std::pair<PathView, PathView> Split(PathView path) noexcept {
+		auto end = path.size();
+		while (end > 0 && !IsSeparator(path[end - 1]))
+			--end;
+		if (end == 0)
+			return {{}, path};
+		return {path.substr(0, end - 1), path.substr(end)};
+	}
+
+	bool Equal(PathView lhs, std::string_view rhs) noexcept {
+		return std::equal(lhs.begin(),
+											lhs.end(),
+											rhs.begin(),
+											rhs.end(),
+											[](auto l, char r) {
+												return l == static_cast<PathView::value_type>(r);
+											});
+	}
+
+	bool StartsWith(PathView str, std::string_view prefix) noexcept {
+		return str.size() >= prefix.size() &&
+					 Equal(str.substr(0, prefix.size()), prefix);
+	}
+
+	bool EndsWith(PathView str, std::string_view suffix) noexcept {
+		return str.size() >= suffix.size() &&
+					 Equal(str.substr(str.size() - suffix.size()), suffix);
+	}
+
+	template <typename Char>
+	uint32_t ShardOfName(std::basic_string_view<Char> name, uint32_t count) {
+		if constexpr (std::is_same_v<Char, char>)
+			return ShardOf(name, count);
+		else {
+			// Save file names are ASCII, so nothing is lost narrowing them.
+			std::string narrow(name.size(), '\0');
+			std::transform(name.begin(), name.end(), narrow.begin(), [](Char c) {
+				return static_cast<char>(c);
+			});
+			return ShardOf(narrow, count);
+		}
+	}
+
+	// Empty rules match anything.
+	template <typename Fn>
+	bool MatchesAny(const std::vector<std::string>& rules, Fn&& matches) {
+		return rules.empty() || std::any_of(rules.begin(), rules.end(), matches);
+	}
+} // namespace
+
+PathRouter::PathRouter(IFileOps& fileOps, Config config) :
+		fileOps{fileOps}, config{std::move(config)} {
+	BlobCache::Instance().SetBudget(this->config.cacheMiB << 20);
+}
+
+const PathRouter::SaveDir* PathRouter::Find(PathView dir) const noexcept {
+	for (auto& save : saves)
+		for (auto& spelling : save.spellings)
+			if (PathView{spelling} == dir)
+				return &save;
+	return nullptr;
+}
+
+fs::path::string_type PathRouter::Key(PathView path) {
+	auto key = fs::path{path}.lexically_normal().native();
+	// Normalizing keeps a trailing separator, which a directory spelled with
+	// one more component such as a/b/. ends in.
+	if (key.size() > 1 && IsSeparator(key.back()))
+		key.pop_back();
+	return key;
+}
+
+SaveDB& PathRouter::Route(const SaveDir& save, PathView name) {
+	auto count = static_cast<uint32_t>(save.shards.size());
+	if (count == 1) [[likely]]
+		return *save.shards.front();
+	return *save.shards[ShardOfName(name, count)];
+}
+
+bool PathRouter::MatchesName(PathView path) const noexcept {
+	auto name		= Split(path).second;
+	auto& rules = config.intercept;
+	return MatchesAny(rules.extensions,
+										[&](auto& ext) { return EndsWith(name, ext); }) &&
+				 MatchesAny(rules.prefixes,
+										[&](auto& prefix) { return StartsWith(name, prefix); });
+}
+
+bool PathRouter::ShouldIntercept(PathView path) const noexcept {
+	if (!MatchesName(path)) [[likely]]
+		return false;
+	auto dir		 = Split(path).first;
+	auto modeDir = Split(dir).first;
+	auto saves	 = Split(Split(modeDir).first).second;
+	// Saves must have a parent, i.e. a separator in front of it.
+	if (saves.data() == path.data() || !Equal(saves, "Saves")) [[unlikely]]
+		return false;
+	{
+		std::shared_lock l{mutex};
+		if (Find(dir)) [[likely]]
+			return true;
+	}
+	return fileOps.FileExists(fs::path{dir});
+}
+
+SaveDB& PathRouter::Database(PathView path) {
+	auto [dir, name] = Split(path);
+	{
+		std::shared_lock l{mutex};
+		if (auto save = Find(dir)) [[likely]]
+			return Route(*save, name);
+	}
+	std::lock_guard l{mutex};
+	if (auto save = Find(dir))
+		return Route(*save, name);
+	auto key = Key(dir);
+	for (auto& save : saves)
+		if (save.dir == key) {
+			save.spellings.emplace_back(dir);
+			return Route(save, name);
+		}
+	fs::path saveDir{key};
+	SaveDir save{key, {fs::path::string_type{dir}}, {}, {}};
+	std::vector<fs::path> paths;
+	for (uint32_t i = 0; i < config.shards; ++i) {
+		save.shards.push_back(std::make_unique<SaveDB>(
+				ShardPath(saveDir, i),
+				config.commit,
+				StorageOptions{.codec			= config.codec,
+											 .mmapSize	= config.mmapMiB << 20,
+											 .segmented = config.segmented,
+											 .shards		= config.shards}));
+		paths.push_back(save.shards.back()->Path());
+	}
+	if (auto& policy = config.snapshot; policy.interval.count() > 0) {
+		auto into			 = Snapshotter::DirFor(policy, saveDir);
+		save.snapshots = std::make_unique<Snapshotter>(
+				std::move(paths), std::move(into), policy, SaveDB::Verify);
+	}
+	return Route(saves.emplace_back(std::move(save)), name);
+}
@@ -1,120 +1,373 @@
-#include "SQLite.h"
-
-#include <cassert>
-#include <string>
-
-using namespace std::string_literals;
-
-using namespace ZomboidHook;
-
-SQLStatement::SQLStatement(sqlite3* db, std::string_view query) {
-	if (SQLITE_OK != sqlite3_prepare_v3(db,
-																			query.data(),
-																			query.size(),
-																			SQLITE_PREPARE_PERSISTENT,
-																			&stmt,
-																			nullptr))
-		throw std::runtime_error{"Failed to prepare statement: "s.append(query)};
-}
-
-SQLStatement::SQLStatement(SQLStatement&& rhs) noexcept : stmt{rhs.stmt} {
-	rhs.stmt = nullptr;
-}
-
-SQLStatement::~SQLStatement() {
-	sqlite3_finalize(stmt);
-}
-
-SQLConn::SQLConn(const std::filesystem::path& path) {
-	if (SQLITE_OK != sqlite3_open_v2(path.string().c_str(),
-																	 &db,
-																	 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
-																	 "win32-longpath")) [[unlikely]]
-		throw std::runtime_error{"Failed to open DB"s + sqlite3_errmsg(db)};
-}
-
-SQLConn::SQLConn(SQLConn&& rhs) noexcept : db{rhs.db} {
-	rhs.db = nullptr;
-}
-
-SQLConn::operator sqlite3*() const noexcept {
-	return db;
-}
-
-SQLConn::~SQLConn() {
-	sqlite3_exec(db, "VACUUM", nullptr, nullptr, nullptr);
-	sqlite3_close(db);
-}
-
-SQLite::SQLite(std::filesystem::path path, std::string_view schema) :
-		conn{path}, path{std::move(path)} {
-	if (!schema.empty())
-		Execute(schema);
-	Execute("PRAGMA journal_mode=wal");
-}
-
-SQLite::operator sqlite3*() noexcept {
-	return conn;
-}
-
-size_t SQLite::PrepareStatement(std::string_view query) {
-	statements.emplace_back(conn, query);
-	return statements.size() - 1;
-}
-
-void SQLite::Execute(std::string_view query) {
-	sqlite3_exec(conn, query.data(), nullptr, nullptr, nullptr);
-}
-
-const std::filesystem::path& SQLite::Path() const noexcept {
-	return path;
-}
-
-int64_t SQLite::LastInsertRowID() const noexcept {
-	return sqlite3_last_insert_rowid(conn);
-}
-
-int SQLite::RowsChanged() const noexcept {
-	return sqlite3_changes(conn);
-}
-
-SQLStatement& SQLite::operator[](size_t idx) noexcept {
-	return statements[idx];
-}
-
-SQLBlob::SQLBlob(SQLite& db,
-								 const char* table,
-								 const char* col,
-								 sqlite3_int64 row) {
-	if (SQLITE_OK != sqlite3_blob_open(db, "main", table, col, row, 1, &blob))
-			[[unlikely]]
-		throw std::runtime_error{"Failed to open blob"};
-}
-
-void SQLBlob::Read(uint8_t* buf, size_t offset, size_t len) const {
-	assert(len <= std::numeric_limits<int>::max());
-	if (sqlite3_blob_read(blob, buf, static_cast<int>(len), offset)) [[unlikely]]
-		throw std::runtime_error{"Failed to read blob"};
-}
-
-void SQLBlob::Write(std::pair<const uint8_t*, size_t> buf, size_t offset) {
-	auto [data, len] = buf;
-	assert(len <= std::numeric_limits<int>::max());
-	if (SQLITE_OK !=
-			sqlite3_blob_write(blob, data, static_cast<int>(len), offset))
-			[[unlikely]]
-		throw std::runtime_error{"Failed to write blob"};
-}
-
-void SQLBlob::Reopen(sqlite3_int64 rowID) {
-	if (SQLITE_OK != sqlite3_blob_reopen(blob, rowID)) [[unlikely]]
-		throw std::runtime_error{"Failed to reopen blob"};
-}
-
-size_t SQLBlob::Size() const noexcept {
-	return sqlite3_blob_bytes(blob);
-}
-
-SQLBlob::~SQLBlob() {
-	sqlite3_blob_close(blob);
-}
+#include "SQLite.h"
+
+#include <cassert>
+#include <string>
+
+using namespace std::string_literals;
+
+using namespace ZomboidHook;
+
+SQLStatement::SQLStatement(sqlite3* db, std::string_view query) {
+	if (SQLITE_OK != sqlite3_prepare_v3(db,
+																			query.data(),
+																			query.size(),
+																			SQLITE_PREPARE_PERSISTENT,
+																			&stmt,
+																			nullptr))
+		throw std::runtime_error{"Failed to prepare statement: "s.append(query)};
+}
+
+SQLStatement::SQLStatement(SQLStatement&& rhs) noexcept : stmt{rhs.stmt} {
+	rhs.stmt = nullptr;
+}
+
+SQLStatement::~SQLStatement() {
+	sqlite3_finalize(stmt);
+}
+
+#ifdef _WIN32
+static constexpr auto vfsName = "win32-longpath";
+#else
+static constexpr const char* vfsName = nullptr;
+#endif
+
+SQLConn::SQLConn(const std::filesystem::path& path, int flags) {
+	if (SQLITE_OK !=
+			sqlite3_open_v2(path.string().c_str(), &db, flags, vfsName)) [[unlikely]]
+		throw std::runtime_error{"Failed to open DB"s + sqlite3_errmsg(db)};
+}
+
+SQLConn::SQLConn(SQLConn&& rhs) noexcept : db{rhs.db} {
+	rhs.db = nullptr;
+}
+
+SQLConn::operator sqlite3*() const noexcept {
+	return db;
+}
+
+void SQLConn::Close() noexcept {
+	if (!db)
+		return;
+	sqlite3_close(db);
+	db = nullptr;
+}
+
+SQLConn::~SQLConn() {
+	Close();
+}
+
+SQLSession::SQLSession(const std::filesystem::path& path, int flags) :
+		conn{path, flags} {}
+
+SQLSession::operator sqlite3*() noexcept {
+	return conn;
+}
+
+size_t SQLSession::PrepareStatement(std::string_view query) {
+	statements.emplace_back(conn, query);
+	return statements.size() - 1;
+}
+
+bool SQLSession::Execute(std::string_view query) {
+	return SQLITE_OK ==
+				 sqlite3_exec(conn, query.data(), nullptr, nullptr, nullptr);
+}
+
+void SQLSession::CreateFunction(const char* name, int argCount, ScalarFn fn) {
+	if (SQLITE_OK != sqlite3_create_function_v2(conn,
+																							name,
+																							argCount,
+																							SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+																							nullptr,
+																							fn,
+																							nullptr,
+																							nullptr,
+																							nullptr)) [[unlikely]]
+		throw std::runtime_error{"Failed to create function "s + name};
+}
+
+SQLStatement& SQLSession::operator[](size_t idx) noexcept {
+	return statements[idx];
+}
+
+bool CommitPolicy::Grouped() const noexcept {
+	return durability == Durability::OFF || durability == Durability::GROUP;
+}
+
+SQLite::Mutation::Mutation(SQLite& db) :
+		db{db},
+		nested{db.Mutating()},
+		lock{db.txnMutex, std::defer_lock} {
+	if (nested)
+		return;
+	lock.lock();
+	// Joins the group, or a transaction the caller began on its own.
+	if (!db.inTxn && sqlite3_get_autocommit(db.conn) != 0) {
+		if (!db.Execute("BEGIN")) [[unlikely]]
+			throw std::runtime_error{"Failed to begin transaction: "s +
+															 sqlite3_errmsg(db.conn)};
+		if (db.policy.Grouped()) {
+			db.inTxn		= true;
+			db.txnOps		= 0;
+			db.txnStart = db.lastOp = std::chrono::steady_clock::now();
+			db.txnCondVar.notify_one();
+		} else
+			own = true;
+	}
+	db.mutator.store(std::this_thread::get_id(), std::memory_order_relaxed);
+}
+
+SQLite::Mutation::~Mutation() noexcept(false) {
+	if (nested)
+		return;
+	db.mutator.store({}, std::memory_order_relaxed);
+	db.lastOp = std::chrono::steady_clock::now();
+	if (db.vacuums && !db.vacuumPending) {
+		db.vacuumPending = true;
+		db.txnCondVar.notify_one();
+	}
+	if (own) {
+		if (std::uncaught_exceptions() > exceptions) {
+			db.Execute("ROLLBACK");
+			db.Mutated(false);
+			return;
+		}
+		bool committed;
+		{
+			Metrics::Timer timer{Metric::SQL_COMMIT};
+			committed = db.Execute("COMMIT");
+		}
+		if (!committed) [[unlikely]] {
+			std::string error = sqlite3_errmsg(db.conn);
+			db.Execute("ROLLBACK"); // Unless SQLite has already.
+			db.Mutated(false);
+			throw std::runtime_error{"Failed to commit: " + error};
+		}
+		db.CountCache();
+		db.Mutated(true);
+		return;
+	}
+	// Whatever ran stays in the group or the caller's transaction, even when
+	// left by an exception.
+	db.Mutated(true);
+	if (!db.inTxn) {
+		db.CountCache();
+		return;
+	}
+	if (++db.txnOps < db.policy.maxOps &&
+			db.lastOp - db.txnStart < db.policy.window)
+		return;
+	try {
+		db.CommitLocked();
+	} catch (const std::exception&) {
+		// The mutation itself is in the group; the committer retries the commit.
+	}
+}
+
+SQLite::SQLite(std::filesystem::path path,
+							 std::string_view schema,
+							 CommitPolicy policy) :
+		SQLSession{path}, path{std::move(path)}, policy{policy} {
+	// Only takes effect on a new database; existing ones are converted by
+	// ZomboidTool compact.
+	Execute("PRAGMA auto_vacuum=INCREMENTAL");
+	if (!schema.empty())
+		Execute(schema);
+	Execute("PRAGMA journal_mode=wal");
+	vacuums = policy.vacuumPages > 0 &&
+						SQLStatement{conn, "PRAGMA auto_vacuum"}.Execute(
+								[](int mode) { return mode; }) == 2;
+	switch (policy.durability) {
+		case Durability::OFF:
+			Execute("PRAGMA synchronous=OFF");
+			break;
+		case Durability::FULL:
+			Execute("PRAGMA synchronous=FULL");
+			break;
+		default:
+			break;
+	}
+	if (policy.Grouped() || vacuums)
+		committer = std::jthread{[this](std::stop_token stop) {
+			CommitLoop(std::move(stop));
+		}};
+}
+
+void SQLite::CommitLocked() {
+	if (!inTxn)
+		return;
+	bool committed;
+	{
+		Metrics::Timer timer{Metric::SQL_COMMIT};
+		committed = Execute("COMMIT");
+	}
+	if (!committed) [[unlikely]] {
+		std::runtime_error failed{"Failed to commit: "s + sqlite3_errmsg(conn)};
+		// A busy commit leaves the transaction open to be retried, while an I/O
+		// error or a full disk may have rolled it back.
+		inTxn = sqlite3_get_autocommit(conn) == 0;
+		if (!inTxn)
+			RolledBack();
+		throw failed;
+	}
+	inTxn = false;
+	commits.fetch_add(1, std::memory_order_release);
+	CountCache();
+}
+
+void SQLite::CountCache() noexcept {
+	auto& block = Metrics::Instance().Block();
+	auto count	= [&](int op, std::atomic<uint64_t>& to) {
+		int current = 0;
+		int highwater;
+		sqlite3_db_status(conn, op, &current, &highwater, true);
+		to.fetch_add(current, std::memory_order_relaxed);
+	};
+	count(SQLITE_DBSTATUS_CACHE_HIT, block.cacheHits);
+	count(SQLITE_DBSTATUS_CACHE_MISS, block.cacheMisses);
+	count(SQLITE_DBSTATUS_CACHE_WRITE, block.cacheWrites);
+}
+
+void SQLite::CommitLoop(std::stop_token stop) {
+	std::unique_lock l{txnMutex};
+	while (!stop.stop_requested()) {
+		if (!inTxn && !vacuumPending) {
+			txnCondVar.wait(l, stop, [&] { return inTxn || vacuumPending; });
+			continue;
+		}
+		auto wakeAt = lastOp + policy.idleGap;
+		if (inTxn)
+			wakeAt = std::min(wakeAt, txnStart + policy.window);
+		txnCondVar.wait_until(l, stop, wakeAt, [] { return false; });
+		auto now = std::chrono::steady_clock::now();
+		if (now < lastOp + policy.idleGap &&
+				(!inTxn || now < txnStart + policy.window))
+			continue;
+		if (!inTxn) {
+			VacuumLocked(l, stop);
+			continue;
+		}
+		try {
+			CommitLocked();
+		} catch (const std::exception&) {
+			// Backs off for an idle gap before trying again.
+			txnCondVar.wait_for(l, stop, policy.idleGap, [] { return false; });
+		}
+	}
+}
+
+void SQLite::VacuumLocked(std::unique_lock<std::mutex>& l,
+													std::stop_token& stop) {
+	// Each step frees at most 256 pages, so a mutation arriving meanwhile
+	// waits for one step at worst.
+	static constexpr auto stepQuery = "PRAGMA incremental_vacuum(256)";
+	static constexpr std::chrono::milliseconds stepGap{10};
+
+	vacuumPending = false;
+	SQLStatement freeList{conn, "PRAGMA freelist_count"};
+	auto freePages = [&] {
+		return freeList.Execute([](int count) { return count; });
+	};
+	if (static_cast<uint32_t>(freePages()) < policy.vacuumPages)
+		return;
+	while (Execute(stepQuery) && freePages() > 0) {
+		auto interrupted = [&] { return inTxn || vacuumPending; };
+		if (txnCondVar.wait_for(l, stop, stepGap, interrupted) ||
+				stop.stop_requested())
+			return;
+	}
+}
+
+SQLite::Mutation SQLite::Mutate() {
+	return Mutation{*this};
+}
+
+void SQLite::Commit() {
+	std::lock_guard l{txnMutex};
+	CommitLocked();
+}
+
+const CommitPolicy& SQLite::Policy() const noexcept {
+	return policy;
+}
+
+bool SQLite::Mutating() const noexcept {
+	return mutator.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+uint64_t SQLite::Commits() const noexcept {
+	return commits.load(std::memory_order_acquire);
+}
+
+const std::filesystem::path& SQLite::Path() const noexcept {
+	return path;
+}
+
+sqlite3_int64 SQLite::LastInsertRowID() const noexcept {
+	return sqlite3_last_insert_rowid(conn);
+}
+
+int SQLite::RowsChanged() const noexcept {
+	return sqlite3_changes(conn);
+}
+
+int SQLite::TotalChanges() const noexcept {
+	return sqlite3_total_changes(conn);
+}
+
+void SQLite::Close() noexcept {
+	if (committer.joinable()) {
+		committer.request_stop();
+		committer.join();
+	}
+	try {
+		Commit();
+	} catch (const std::exception&) {
+		// Closing the connection rolls back what could not be committed.
+	}
+	statements.clear();
+	conn.Close();
+}
+
+SQLite::~SQLite() {
+	Close();
+}
+
+SQLBlob::SQLBlob(SQLSession& db,
+								 const char* table,
+								 const char* col,
+								 sqlite3_int64 row,
+								 bool writable) {
+	if (SQLITE_OK !=
+			sqlite3_blob_open(db, "main", table, col, row, writable, &blob))
+			[[unlikely]]
+		throw std::runtime_error{"Failed to open blob"};
+}
+
+void SQLBlob::Read(uint8_t* buf, size_t offset, size_t len) const {
+	assert(len <= std::numeric_limits<int>::max());
+	if (sqlite3_blob_read(blob, buf, static_cast<int>(len), offset)) [[unlikely]]
+		throw std::runtime_error{"Failed to read blob"};
+}
+
+void SQLBlob::Write(std::pair<const uint8_t*, size_t> buf, size_t offset) {
+	auto [data, len] = buf;
+	assert(len <= std::numeric_limits<int>::max());
+	if (SQLITE_OK !=
+			sqlite3_blob_write(blob, data, static_cast<int>(len), offset))
+			[[unlikely]]
+		throw std::runtime_error{"Failed to write blob"};
+}
+
+void SQLBlob::Reopen(sqlite3_int64 rowID) {
+	if (SQLITE_OK != sqlite3_blob_reopen(blob, rowID)) [[unlikely]]
+		throw std::runtime_error{"Failed to reopen blob"};
+}
+
+size_t SQLBlob::Size() const noexcept {
+	return sqlite3_blob_bytes(blob);
+}
+
+SQLBlob::~SQLBlob() {
+	sqlite3_blob_close(blob);
+}
@@ -0,0 +1,928 @@
+#include "SaveDB.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+
+#include "BlobCache.h"
+#include "Metrics.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+namespace {
+	// Manifests are hashed with their own seed, so that their digests never
+	// stand for the same bytes stored as a file.
+	constexpr uint32_t manifestSeed = 1;
+
+	// The data of a manifest blob: the segment size as 4 little endian bytes,
+	// then the digest of each segment in order.
+	struct Manifest {
+		uint32_t segmentSize = SaveDB::segmentSize;
+		std::vector<Digest> segments;
+
+		static Manifest Parse(std::pair<const uint8_t*, size_t> data) {
+			auto [bytes, len] = data;
+			constexpr auto digestLen = sizeof(Digest::bytes);
+			if (len < 4 || (len - 4) % digestLen != 0) [[unlikely]]
+				throw std::runtime_error{"Corrupt manifest"};
+			Manifest manifest;
+			manifest.segmentSize = 0;
+			for (auto i = 0; i < 4; ++i)
+				manifest.segmentSize |= uint32_t{bytes[i]} << (8 * i);
+			if (manifest.segmentSize == 0) [[unlikely]]
+				throw std::runtime_error{"Corrupt manifest"};
+			manifest.segments.resize((len - 4) / digestLen);
+			for (auto& digest : manifest.segments) {
+				std::memcpy(digest.bytes.data(), bytes + 4, digestLen);
+				bytes += digestLen;
+			}
+			return manifest;
+		}
+
+		std::vector<uint8_t> Serialize() const {
+			std::vector<uint8_t> data;
+			data.reserve(4 + segments.size() * sizeof(Digest::bytes));
+			for (auto i = 0; i < 4; ++i)
+				data.push_back(static_cast<uint8_t>(segmentSize >> (8 * i)));
+			for (auto& digest : segments)
+				data.insert(data.end(), digest.bytes.begin(), digest.bytes.end());
+			return data;
+		}
+	};
+
+	// content_hash(data, codec, size): the digest of a stored blob's unpacked
+	// contents, or of the manifest itself, NULL for NULL data.
+	void ContentHash(sqlite3_context* ctx, int, sqlite3_value** args) {
+		if (sqlite3_value_type(args[0]) == SQLITE_NULL) {
+			sqlite3_result_null(ctx);
+			return;
+		}
+		std::pair data{static_cast<const uint8_t*>(sqlite3_value_blob(args[0])),
+									 static_cast<size_t>(sqlite3_value_bytes(args[0]))};
+		Digest digest;
+		try {
+			if (auto codec = static_cast<Codec>(sqlite3_value_int(args[1]));
+					codec == Codec::NONE)
+				digest = HashContent(data);
+			else if (codec == Codec::SEGMENTS)
+				digest = HashContent(data, manifestSeed);
+			else {
+				std::vector<uint8_t> unpacked(sqlite3_value_int64(args[2]));
+				Decode(codec, data, unpacked.data(), unpacked.size());
+				digest = HashContent({unpacked.data(), unpacked.size()});
+			}
+		} catch (const std::exception& e) {
+			sqlite3_result_error(ctx, e.what(), -1);
+			return;
+		}
+		auto [bytes, len] = digest.Data();
+		sqlite3_result_blob(ctx, bytes, static_cast<int>(len), SQLITE_TRANSIENT);
+	}
+
+	// chunk_key(name): the ChunkKey of a file name, NULL if it has none.
+	void ChunkKeyFn(sqlite3_context* ctx, int, sqlite3_value** args) {
+		auto text = sqlite3_value_text(args[0]);
+		auto key	= text ? ChunkKey(reinterpret_cast<const char*>(text))
+										 : std::nullopt;
+		if (key)
+			sqlite3_result_int64(ctx, *key);
+		else
+			sqlite3_result_null(ctx);
+	}
+
+	// Moves the files (name, data) table used before contents were shared,
+	// along with the codecs of its packed rows, into entries and blobs.
+	// With max() as the only other aggregate, the bare columns of each group
+	// come from the row holding its maximum, so codec and data always match.
+	constexpr auto importFlatTable = R"(
+		BEGIN;
+		CREATE TABLE IF NOT EXISTS codecs (
+			name TEXT PRIMARY KEY, codec INTEGER NOT NULL, size INTEGER NOT NULL);
+		INSERT INTO blobs(hash, refs, codec, size, data)
+			SELECT content_hash(files.data, ifnull(codecs.codec, 0),
+													ifnull(codecs.size, length(files.data))) AS digest,
+				COUNT(1), max(ifnull(codecs.codec, 0)),
+				ifnull(codecs.size, length(files.data)), files.data
+			FROM files LEFT JOIN codecs ON codecs.name = files.name
+			WHERE files.data IS NOT NULL GROUP BY digest;
+		INSERT INTO entries(name, hash)
+			SELECT files.name,
+				content_hash(files.data, ifnull(codecs.codec, 0),
+										 ifnull(codecs.size, length(files.data)))
+			FROM files LEFT JOIN codecs ON codecs.name = files.name;
+		DROP TABLE files;
+		DROP TABLE codecs;
+		COMMIT;)";
+
+	// Moves chunk files left in entries, by builds that kept every file there,
+	// to chunks.
+	constexpr auto moveChunks = R"(
+		BEGIN;
+		INSERT OR REPLACE INTO chunks(key, hash)
+			SELECT chunk_key(name), hash FROM entries
+			WHERE chunk_key(name) IS NOT NULL;
+		DELETE FROM entries WHERE chunk_key(name) IS NOT NULL;
+		COMMIT;)";
+} // namespace
+
+SaveDB::ReaderLease::~ReaderLease() {
+	if (reader)
+		db->ReturnReader(std::move(reader));
+}
+
+SaveDB::SaveDB(std::filesystem::path path,
+							 CommitPolicy policy,
+							 StorageOptions options) :
+		SQLite{std::move(path),
+					 // A NULL hash is the tombstone of a deleted file.
+					 "CREATE TABLE IF NOT EXISTS entries (name TEXT PRIMARY KEY, hash BLOB);"
+					 "CREATE TABLE IF NOT EXISTS chunks (key INTEGER PRIMARY KEY, hash BLOB);"
+					 "CREATE TABLE IF NOT EXISTS blobs (hash BLOB PRIMARY KEY, "
+					 "refs INTEGER NOT NULL, codec INTEGER NOT NULL, "
+					 "size INTEGER NOT NULL, data BLOB)",
+					 policy},
+		getBlobStmt{PreparePair(readQueries[0], readQueries[1])},
+		getSegmentStmt{PrepareStatement(readQueries[2])},
+		statBlobStmt{PrepareStatement(readQueries[3])},
+		getHashStmt{PreparePair("SELECT hash FROM entries WHERE name = ?1",
+														"SELECT hash FROM chunks WHERE key = ?1")},
+		upsertEntryStmt{PreparePair(
+				"INSERT OR REPLACE INTO entries(name, hash) VALUES(?1, ?2)",
+				"INSERT OR REPLACE INTO chunks(key, hash) VALUES(?1, ?2)")},
+		deleteStmt{
+				PreparePair("UPDATE entries SET hash = NULL WHERE name = ?1",
+										"UPDATE chunks SET hash = NULL WHERE key = ?1")},
+		refBlobStmt{PrepareStatement(
+				"UPDATE blobs SET refs = refs + 1 WHERE hash = ?1")},
+		unrefBlobStmt{PrepareStatement(
+				"UPDATE blobs SET refs = refs - 1 WHERE hash = ?1")},
+		dropBlobStmt{
+				PrepareStatement("DELETE FROM blobs WHERE hash = ?1 AND refs <= 0")},
+		insertBlobStmt{
+				PrepareStatement("INSERT INTO blobs(hash, refs, codec, size, data) "
+												 "VALUES(?1, 1, ?2, ?3, ?4)")},
+		droppedManifestStmt{PrepareStatement(
+				"SELECT data FROM blobs WHERE hash = ?1 AND refs <= 0 AND codec = 2")},
+		options{options} {
+	if (options.mmapSize > 0) {
+		mmapPragma = "PRAGMA mmap_size=" + std::to_string(options.mmapSize);
+		Execute(mmapPragma);
+	}
+	UpgradeSchema();
+	LoadIndex();
+	CheckShards();
+	if (Policy().writeBehind)
+		writer = std::jthread{[this](std::stop_token stop) { WriteBehind(stop); }};
+}
+
+void SaveDB::UpgradeSchema() {
+	SQLStatement probe{
+			*this, "SELECT COUNT(1) FROM sqlite_master WHERE name = 'files'"};
+	auto flat = probe.Execute([](bool exists) { return exists; });
+	CreateFunction("content_hash", 3, ContentHash);
+	CreateFunction("chunk_key", 1, ChunkKeyFn);
+	if ((flat && !Execute(importFlatTable)) || !Execute(moveChunks))
+			[[unlikely]] {
+		Execute("ROLLBACK");
+		throw std::runtime_error{"Failed to upgrade " + Path().string()};
+	}
+}
+
+void SaveDB::LoadIndex() {
+	auto stat = [](int64_t row, int64_t size, int codec) {
+		return BlobStat{
+				row, static_cast<uint64_t>(size), static_cast<Codec>(codec)};
+	};
+	std::unordered_map<int64_t, BlobStat> chunks;
+	std::unordered_map<std::string, BlobStat> names;
+	// Tombstones join no blob and read back as row 0 of size 0, as they would
+	// from a lookup.
+	SQLStatement{*this,
+							 "SELECT entries.name, blobs.rowid, blobs.size, blobs.codec "
+							 "FROM entries LEFT JOIN blobs ON blobs.hash = entries.hash"}
+			.ForEach(
+					[&](std::string_view name, int64_t row, int64_t size, int codec) {
+						names.try_emplace(std::string{name}, stat(row, size, codec));
+					});
+	SQLStatement{*this,
+							 "SELECT chunks.key, blobs.rowid, blobs.size, blobs.codec "
+							 "FROM chunks LEFT JOIN blobs ON blobs.hash = chunks.hash"}
+			.ForEach([&](int64_t key, int64_t row, int64_t size, int codec) {
+				chunks.try_emplace(key, stat(row, size, codec));
+			});
+	std::lock_guard l{indexMutex};
+	for (auto& [key, stat] : chunkIndex)
+		if (!stat.rowID)
+			chunks.try_emplace(key, stat);
+	for (auto& [name, stat] : nameIndex)
+		if (!stat.rowID)
+			names.try_emplace(name, stat);
+	chunkIndex = std::move(chunks);
+	nameIndex	 = std::move(names);
+	indexChanges.fetch_add(1, std::memory_order_release);
+}
+
+void SaveDB::CheckShards() {
+	SQLStatement probe{*this, "PRAGMA user_version"};
+	auto stored = probe.Execute([](int64_t version) { return version; });
+	if (stored == options.shards || (stored == 0 && options.shards == 1))
+		return;
+	if (stored == 0 && nameIndex.empty() && chunkIndex.empty()) {
+		Execute("PRAGMA user_version=" + std::to_string(options.shards));
+		return;
+	}
+	throw std::runtime_error{Path().string() + " belongs to a save of " +
+													 std::to_string(std::max<int64_t>(stored, 1)) +
+													 " shards, not " + std::to_string(options.shards)};
+}
+
+void SaveDB::Index(const std::string& name, BlobStat stat, bool onlyAdd) {
+	if (!onlyAdd)
+		BlobCache::Instance().Invalidate(this, name);
+	std::lock_guard l{indexMutex};
+	auto key = ChunkKey(name);
+	if (onlyAdd && key)
+		chunkIndex.try_emplace(*key, stat);
+	else if (onlyAdd)
+		nameIndex.try_emplace(name, stat);
+	else if (key)
+		chunkIndex.insert_or_assign(*key, stat);
+	else
+		nameIndex.insert_or_assign(name, stat);
+	if (!onlyAdd)
+		indexChanges.fetch_add(1, std::memory_order_release);
+}
+
+void SaveDB::StageIndex(const std::string& name, BlobStat stat) {
+	if (Mutating())
+		unindexed.emplace_back(name, stat);
+	else
+		Index(name, stat);
+}
+
+void SaveDB::StageCache(const std::string& name, Contents data) {
+	if (Mutating())
+		uncached.emplace_back(name, std::move(data));
+	else
+		BlobCache::Instance().Put(this, name, std::move(data));
+}
+
+void SaveDB::Mutated(bool kept) noexcept {
+	// Until now the readers may not see the rows these point at.
+	if (kept) {
+		for (auto& [name, stat] : unindexed)
+			Index(name, stat);
+		for (auto& [name, data] : uncached)
+			BlobCache::Instance().Put(this, name, std::move(data));
+	}
+	unindexed.clear();
+	uncached.clear();
+}
+
+void SaveDB::RolledBack() {
+	BlobCache::Instance().Clear(this);
+	LoadIndex();
+}
+
+size_t SaveDB::PreparePair(std::string_view byName, std::string_view byKey) {
+	auto first = PrepareStatement(byName);
+	PrepareStatement(byKey);
+	return first;
+}
+
+std::unique_ptr<SQLSession> SaveDB::TakeReader() {
+	{
+		std::unique_lock l{readersMutex};
+		readersCondVar.wait(
+				l, [&] { return !idleReaders.empty() || openReaders < maxReaders; });
+		if (!idleReaders.empty()) {
+			auto reader = std::move(idleReaders.back());
+			idleReaders.pop_back();
+			return reader;
+		}
+		++openReaders;
+	}
+	try {
+		auto reader = std::make_unique<SQLSession>(
+				Path(), SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+		if (!mmapPragma.empty())
+			reader->Execute(mmapPragma);
+		for (auto query : readQueries)
+			reader->PrepareStatement(query);
+		return reader;
+	} catch (...) {
+		std::lock_guard l{readersMutex};
+		--openReaders;
+		readersCondVar.notify_one();
+		throw;
+	}
+}
+
+void SaveDB::ReturnReader(std::unique_ptr<SQLSession> reader) noexcept {
+	std::lock_guard l{readersMutex};
+	idleReaders.push_back(std::move(reader));
+	readersCondVar.notify_one();
+}
+
+bool SaveDB::IsDirty(const std::string& name) {
+	std::lock_guard l{dirtyMutex};
+	return !dirty.empty() && dirtyCommits == Commits() && dirty.contains(name);
+}
+
+SQLSession& SaveDB::ReadSession(const std::string& name, ReaderLease& lease) {
+	if (IsDirty(name))
+		return *this;
+	if (!lease.reader) {
+		lease.reader = TakeReader();
+		lease.db		 = this;
+	}
+	return *lease.reader;
+}
+
+const BlobStat* SaveDB::Find(const std::string& name) const {
+	if (auto key = ChunkKey(name)) {
+		auto it = chunkIndex.find(*key);
+		return it != chunkIndex.end() ? &it->second : nullptr;
+	}
+	auto it = nameIndex.find(name);
+	return it != nameIndex.end() ? &it->second : nullptr;
+}
+
+uint64_t SaveDB::Changes() const noexcept {
+	return indexChanges.load(std::memory_order_acquire) +
+				 queueChanges.load(std::memory_order_acquire);
+}
+
+SaveDB::Contents SaveDB::Queued(const std::string& name) const {
+	if (queuedFiles.load(std::memory_order_acquire) == 0) [[likely]]
+		return nullptr;
+	std::lock_guard l{queueMutex};
+	auto it = queued.find(name);
+	return it != queued.end() ? it->second.data : nullptr;
+}
+
+BlobStat SaveDB::Stat(const std::string& name) const {
+	// Queued files read back as unpacked blobs, deletes as tombstones.
+	if (auto data = Queued(name))
+		return {0, data->size()};
+	std::shared_lock l{indexMutex};
+	auto stat = Find(name);
+	return stat ? *stat : BlobStat{};
+}
+
+bool SaveDB::Exists(const std::string& name) const {
+	return Stat(name).rowID.has_value();
+}
+
+uint64_t SaveDB::Size(const std::string& name) const {
+	return Stat(name).size;
+}
+
+bool SaveDB::KnownMissing(const std::string& name) const {
+	if (Queued(name))
+		return false;
+	std::shared_lock l{indexMutex};
+	auto stat = Find(name);
+	return stat && !stat->rowID;
+}
+
+void SaveDB::MarkMissing(const std::string& name) {
+	Index(name, {}, true); // Loses to a file stored in the meantime.
+}
+
+bool SaveDB::LoadBlob(const std::string& name,
+											ReaderLease& lease,
+											std::vector<uint8_t>& out) {
+	if (auto data = Queued(name)) {
+		out.assign(data->begin(), data->end());
+		return true;
+	}
+	auto found		= false;
+	auto& session = ReadSession(name, lease);
+	ExecuteFor(
+			session,
+			getBlobStmt,
+			name,
+			[&](std::pair<const uint8_t*, size_t> data, int codec, int64_t size) {
+				found = true;
+				out.resize(size);
+				if (size > 0)
+					Unpack(session, data, static_cast<Codec>(codec), out.data(), size);
+			});
+	return found;
+}
+
+SaveDB::Contents SaveDB::LoadWhole(const std::string& name,
+																	 ReaderLease& lease) {
+	if (auto data = Queued(name))
+		return data;
+	auto& cache = BlobCache::Instance();
+	if (auto data = cache.Find(this, name))
+		return data;
+	auto stamp = cache.Stamp(this, name);
+	auto data	 = std::make_shared<std::vector<uint8_t>>();
+	if (!LoadBlob(name, lease, *data))
+		return nullptr;
+	cache.Insert(this, name, data, stamp);
+	return data;
+}
+
+bool SaveDB::ReadWhole(const std::string& name,
+											 ReaderLease& lease,
+											 uint8_t* buf,
+											 size_t len) {
+	auto read			= false;
+	auto& session = ReadSession(name, lease);
+	ExecuteFor(
+			session,
+			getBlobStmt,
+			name,
+			[&](std::pair<const uint8_t*, size_t> data, int codec, int64_t size) {
+				if (static_cast<uint64_t>(size) != len)
+					return;
+				Unpack(session, data, static_cast<Codec>(codec), buf, len);
+				read = true;
+			});
+	return read;
+}
+
+std::vector<Segment> SaveDB::Segments(const std::string& name,
+																			ReaderLease& lease) {
+	auto& session = ReadSession(name, lease);
+	std::optional<Manifest> manifest;
+	ExecuteFor(session,
+						 getBlobStmt,
+						 name,
+						 [&](std::pair<const uint8_t*, size_t> data, int codec, int64_t) {
+							 if (static_cast<Codec>(codec) == Codec::SEGMENTS)
+								 manifest = Manifest::Parse(data);
+						 });
+	std::vector<Segment> segments;
+	if (!manifest)
+		return segments;
+	segments.reserve(manifest->segments.size());
+	for (auto& digest : manifest->segments) {
+		Segment segment{digest};
+		segment.offset = segments.size() * uint64_t{manifest->segmentSize};
+		auto found		 = false;
+		session[statBlobStmt].Execute(
+				[&](int64_t row, int64_t size, int codec) {
+					found					= true;
+					segment.rowID = row;
+					segment.size	= static_cast<uint64_t>(size);
+					segment.codec = static_cast<Codec>(codec);
+				},
+				digest.Data());
+		if (!found) [[unlikely]]
+			throw std::runtime_error{"Missing segment"};
+		segments.push_back(segment);
+	}
+	return segments;
+}
+
+void SaveDB::ForEachFile(
+		const std::function<void(const std::string& name,
+														 std::optional<std::vector<uint8_t>> data)>& fn) {
+	std::vector<std::pair<std::string, BlobStat>> files;
+	{
+		std::shared_lock l{indexMutex};
+		files.reserve(nameIndex.size() + chunkIndex.size());
+		for (auto& [name, stat] : nameIndex)
+			if (stat.rowID)
+				files.emplace_back(name, stat);
+		for (auto& [key, stat] : chunkIndex)
+			if (stat.rowID)
+				files.emplace_back(ChunkName(key), stat);
+	}
+	std::sort(files.begin(), files.end(), [](auto& lhs, auto& rhs) {
+		return lhs.second.rowID < rhs.second.rowID;
+	});
+	SQLStatement getData{*this, "SELECT data FROM blobs WHERE rowid = ?1"};
+	std::vector<uint8_t> data;
+	int64_t loaded = 0;
+	for (size_t i = 0; i < files.size(); ++i) {
+		auto& [name, stat] = files[i];
+		auto row					 = *stat.rowID;
+		if (row == 0) { // A tombstone.
+			fn(name, std::nullopt);
+			continue;
+		}
+		if (row != loaded) {
+			auto found = false;
+			data.resize(stat.size);
+			getData.Execute(
+					[&](std::pair<const uint8_t*, size_t> stored) {
+						found = true;
+						if (!data.empty())
+							Unpack(*this, stored, stat.codec, data.data(), data.size());
+					},
+					row);
+			if (!found) [[unlikely]]
+				throw std::runtime_error{"Missing blob of " + name};
+			loaded = row;
+		}
+		// Files with the same contents, such as untouched chunks, share a blob,
+		// which is only read once for all of them.
+		if (i + 1 < files.size() && files[i + 1].second.rowID == row)
+			fn(name, data);
+		else {
+			fn(name, std::move(data));
+			loaded = 0;
+		}
+	}
+}
+
+void SaveDB::LoadSegment(const std::string& name,
+												 const Segment& segment,
+												 ReaderLease& lease,
+												 std::vector<uint8_t>& out) {
+	auto found = false;
+	ReadSession(name, lease)[getSegmentStmt].Execute(
+			[&](std::pair<const uint8_t*, size_t> data, int codec, int64_t size) {
+				found = true;
+				out.resize(size);
+				Decode(static_cast<Codec>(codec), data, out.data(), size);
+			},
+			segment.digest.Data());
+	if (!found) [[unlikely]]
+		throw std::runtime_error{"Missing segment"};
+}
+
+void SaveDB::Unpack(SQLSession& session,
+										std::pair<const uint8_t*, size_t> stored,
+										Codec codec,
+										uint8_t* buf,
+										size_t len) {
+	if (codec == Codec::SEGMENTS)
+		ReadSegments(session, stored, 0, len, buf);
+	else
+		Decode(codec, stored, buf, len);
+}
+
+void SaveDB::ReadSegments(SQLSession& session,
+													std::pair<const uint8_t*, size_t> manifest,
+													uint64_t offset,
+													size_t len,
+													uint8_t* buf) {
+	auto [segmentLen, segments] = Manifest::Parse(manifest);
+	std::vector<uint8_t> unpacked;
+	while (len > 0) {
+		auto index	= offset / segmentLen;
+		auto within = offset % segmentLen;
+		auto count	= std::min<uint64_t>(len, segmentLen - within);
+		if (index >= segments.size()) [[unlikely]]
+			throw std::runtime_error{"Read past the last segment"};
+		auto found = false;
+		session[getSegmentStmt].Execute(
+				[&](std::pair<const uint8_t*, size_t> data, int codec, int64_t size) {
+					found = true;
+					if (within + count > static_cast<uint64_t>(size)) [[unlikely]]
+						throw std::runtime_error{"Segment too short"};
+					if (static_cast<Codec>(codec) == Codec::NONE) {
+						if (within + count > data.second) [[unlikely]]
+							throw std::runtime_error{"Blob size mismatch"};
+						std::copy_n(data.first + within, count, buf);
+						return;
+					}
+					unpacked.resize(size);
+					Decode(static_cast<Codec>(codec), data, unpacked.data(), size);
+					std::copy_n(unpacked.data() + within, count, buf);
+				},
+				segments[index].Data());
+		if (!found) [[unlikely]]
+			throw std::runtime_error{"Missing segment"};
+		buf += count;
+		offset += count;
+		len -= count;
+	}
+}
+
+std::optional<Digest> SaveDB::GetHash(const std::string& name) {
+	std::optional<Digest> digest;
+	ExecuteFor(*this,
+						 getHashStmt,
+						 name,
+						 [&](std::pair<const uint8_t*, size_t> hash) {
+							 if (hash.second == sizeof(Digest::bytes))
+								 std::memcpy(
+										 digest.emplace().bytes.data(), hash.first, hash.second);
+						 });
+	return digest;
+}
+
+bool SaveDB::Ref(const Digest& digest) {
+	(*this)[refBlobStmt].Execute(digest.Data());
+	return RowsChanged() != 0;
+}
+
+bool SaveDB::Link(const std::string& name, const Digest& digest) {
+	auto old = GetHash(name);
+	if (old == digest)
+		return true; // Rewritten with the same contents, nothing changes.
+	MarkDirty(name);
+	ExecuteFor(*this, upsertEntryStmt, name, [] {}, digest.Data());
+	if (old)
+		Unref(*old);
+	if (!Ref(digest))
+		return false;
+	(*this)[statBlobStmt].Execute(
+			[&](int64_t row, int64_t size, int codec) {
+				StageIndex(
+						name,
+						{row, static_cast<uint64_t>(size), static_cast<Codec>(codec)});
+			},
+			digest.Data());
+	return true;
+}
+
+void SaveDB::Unref(const Digest& digest) {
+	(*this)[unrefBlobStmt].Execute(digest.Data());
+	// A manifest about to be dropped releases its segments along with it.
+	std::optional<Manifest> manifest;
+	(*this)[droppedManifestStmt].Execute(
+			[&](std::pair<const uint8_t*, size_t> data) {
+				manifest = Manifest::Parse(data);
+			},
+			digest.Data());
+	(*this)[dropBlobStmt].Execute(digest.Data());
+	if (!manifest)
+		return;
+	// Segments are never manifests themselves, so they are all released in
+	// two passes rather than an Unref each.
+	auto bind = [](const Digest& segment) {
+		return std::make_tuple(segment.Data());
+	};
+	ExecuteBatch(unrefBlobStmt, manifest->segments, bind);
+	ExecuteBatch(dropBlobStmt, manifest->segments, bind);
+}
+
+int64_t SaveDB::InsertData(const Digest& digest,
+													 std::pair<const uint8_t*, size_t> stored,
+													 Codec codec,
+													 size_t size) {
+	auto codecID = static_cast<int>(codec);
+	auto len		 = static_cast<int64_t>(size);
+	if (stored.second > 0)
+		(*this)[insertBlobStmt].Execute(digest.Data(), codecID, len, stored);
+	else // A zero-length blob rather than NULL, so that it can still be opened.
+		(*this)[insertBlobStmt].Execute(digest.Data(), codecID, len, ZeroBlob{0});
+	Metrics::Instance().Block().bytesStored.fetch_add(
+			stored.second, std::memory_order_relaxed);
+	return LastInsertRowID();
+}
+
+void SaveDB::InsertBlob(const std::string& name,
+												const Digest& digest,
+												std::pair<const uint8_t*, size_t> stored,
+												Codec codec,
+												size_t size) {
+	StageIndex(name, {InsertData(digest, stored, codec, size), size, codec});
+}
+
+void SaveDB::PutSegments(const std::string& name,
+												 const std::vector<Segment>& kept,
+												 std::pair<const uint8_t*, size_t> data) {
+	auto [bytes, len] = data;
+	Manifest manifest;
+	for (auto& segment : kept)
+		manifest.segments.push_back(segment.digest);
+	for (size_t at = 0; at < len; at += segmentSize)
+		manifest.segments.push_back(
+				HashContent({bytes + at, std::min<size_t>(segmentSize, len - at)}));
+	auto list		= manifest.Serialize();
+	auto digest = HashContent({list.data(), list.size()}, manifestSeed);
+	auto stored = false;
+	(*this)[statBlobStmt].Execute([&](int64_t, int64_t, int) { stored = true; },
+																digest.Data());
+	// Segments gain their references before the old file releases its own, so
+	// that those it shares with the new one are kept rather than stored again.
+	if (!stored) {
+		auto bind = [](const Segment& segment) {
+			return std::make_tuple(segment.digest.Data());
+		};
+		if (ExecuteBatch(refBlobStmt, kept, bind) !=
+				static_cast<int64_t>(kept.size())) [[unlikely]] {
+			// Dropped by another handle rewriting the file since they were read,
+			// and with them the only copy of those bytes. Those missing have no
+			// row to release, so this only undoes the references just taken.
+			ExecuteBatch(unrefBlobStmt, kept, bind);
+			throw std::runtime_error{"Missing segment"};
+		}
+		for (size_t i = 0; i < manifest.segments.size() - kept.size(); ++i) {
+			auto& segment = manifest.segments[kept.size() + i];
+			if (Ref(segment))
+				continue;
+			std::pair part{bytes + i * segmentSize,
+										 std::min<size_t>(segmentSize, len - i * segmentSize)};
+			if (Encode(options.codec, part, packed))
+				InsertData(segment,
+									 {packed.data(), packed.size()},
+									 options.codec,
+									 part.second);
+			else
+				InsertData(segment, part, Codec::NONE, part.second);
+		}
+	}
+	auto size = len;
+	for (auto& segment : kept)
+		size += segment.size;
+	if (!Link(name, digest))
+		InsertBlob(
+				name, digest, {list.data(), list.size()}, Codec::SEGMENTS, size);
+}
+
+void SaveDB::PutBlob(const std::string& name,
+										 std::pair<const uint8_t*, size_t> data) {
+	if (options.segmented && data.second > segmentSize) {
+		PutSegments(name, {}, data);
+		return;
+	}
+	auto digest = HashContent(data);
+	if (Link(name, digest))
+		return;
+	if (Encode(options.codec, data, packed))
+		InsertBlob(name,
+							 digest,
+							 {packed.data(), packed.size()},
+							 options.codec,
+							 data.second);
+	else
+		InsertBlob(name, digest, data, Codec::NONE, data.second);
+}
+
+void SaveDB::PutBlob(const std::string& name,
+										 const Digest& digest,
+										 std::pair<const uint8_t*, size_t> stored,
+										 Codec codec,
+										 size_t size) {
+	if (!Link(name, digest))
+		InsertBlob(name, digest, stored, codec, size);
+}
+
+bool SaveDB::DeleteBlob(const std::string& name) {
+	auto old = GetHash(name);
+	MarkDirty(name);
+	ExecuteFor(*this, deleteStmt, name, [] {});
+	auto existed = RowsChanged() != 0;
+	if (existed)
+		StageIndex(name, {0}); // A tombstone, read back as LoadIndex would.
+	if (old)
+		Unref(*old);
+	return existed;
+}
+
+void SaveDB::Store(const std::string& name, std::vector<uint8_t>& data) {
+	if (!Policy().writeBehind) {
+		auto mutation = Mutate();
+		PutBlob(name, {data.data(), data.size()});
+		if (BlobCache::Instance().Fits(data.size()))
+			StageCache(name,
+								 std::make_shared<const std::vector<uint8_t>>(std::move(data)));
+		return;
+	}
+	Enqueue(name,
+					std::make_shared<const std::vector<uint8_t>>(std::move(data)),
+					false);
+}
+
+void SaveDB::Store(const std::string& name,
+									 const std::vector<Segment>& kept,
+									 std::vector<uint8_t>& data) {
+	auto mutation = Mutate();
+	// Not cached, as the contents were never all in memory; indexing the new
+	// row drops what was.
+	PutSegments(name, kept, {data.data(), data.size()});
+}
+
+bool SaveDB::Remove(const std::string& name) {
+	if (!Policy().writeBehind) {
+		auto mutation = Mutate();
+		return DeleteBlob(name);
+	}
+	if (!Exists(name))
+		return false;
+	Enqueue(name, std::make_shared<const std::vector<uint8_t>>(), true);
+	return true;
+}
+
+void SaveDB::Enqueue(const std::string& name, Contents data, bool remove) {
+	std::lock_guard l{queueMutex};
+	auto [it, added] = queued.try_emplace(name);
+	auto& file			 = it->second;
+	file.data				 = std::move(data);
+	file.remove			 = remove;
+	file.failed			 = false;
+	file.seq				 = ++queueSeq;
+	if (added)
+		queuedFiles.fetch_add(1, std::memory_order_release);
+	queueChanges.fetch_add(1, std::memory_order_release);
+	// A file still waiting is only replaced, so rewrites coalesce.
+	if (!file.inQueue) {
+		file.inQueue = true;
+		queue.push_back(name);
+		queueCondVar.notify_all();
+	}
+}
+
+void SaveDB::ApplyQueued(std::unique_lock<std::mutex>& l) {
+	std::vector<std::pair<std::string, QueuedFile>> batch;
+	batch.reserve(queue.size());
+	for (auto& name : queue) {
+		auto& file	 = queued.at(name);
+		file.inQueue = false;
+		batch.emplace_back(name, file);
+	}
+	queue.clear();
+	applying = true;
+	l.unlock();
+
+	try {
+		// One mutation, so that without grouping each batch is one transaction.
+		auto mutation = Mutate();
+		for (auto& [name, file] : batch) {
+			try {
+				if (file.remove)
+					DeleteBlob(name);
+				else {
+					PutBlob(name, {file.data->data(), file.data->size()});
+					StageCache(name, file.data);
+				}
+			} catch (const std::exception&) {
+				file.failed = true;
+			}
+		}
+	} catch (const std::exception&) { // Including a failed commit.
+		for (auto& entry : batch)
+			entry.second.failed = true;
+	}
+
+	l.lock();
+	applying = false;
+	for (auto& [name, file] : batch) {
+		auto it = queued.find(name);
+		if (it == queued.end() || it->second.seq != file.seq)
+			continue; // Queued again meanwhile, the newer one wins.
+		if (file.failed)
+			it->second.failed = true;
+		else {
+			queued.erase(it);
+			queuedFiles.fetch_sub(1, std::memory_order_release);
+			queueChanges.fetch_add(1, std::memory_order_release);
+		}
+	}
+	queueCondVar.notify_all();
+}
+
+void SaveDB::WriteBehind(std::stop_token stop) {
+	// Once stopped this keeps going until the queue is empty.
+	std::unique_lock l{queueMutex};
+	while (queueCondVar.wait(l, stop, [&] { return !queue.empty(); }))
+		ApplyQueued(l);
+}
+
+void SaveDB::Drain() {
+	std::unique_lock l{queueMutex};
+	queueCondVar.wait(l, [&] { return queue.empty() && !applying; });
+}
+
+bool SaveDB::Verify(SQLSession& copy) {
+	copy.CreateFunction("content_hash", 3, ContentHash);
+	auto stmt = copy.PrepareStatement(
+			"SELECT COUNT(1) FROM blobs WHERE hash IS NOT "
+			"content_hash(data, codec, size)");
+	return copy[stmt].Execute([](int64_t corrupt) { return corrupt == 0; });
+}
+
+void SaveDB::MarkDirty(const std::string& name) {
+	// Without grouping every mutation commits as its own transaction before
+	// it is released, so the readers see it at once.
+	if (!Policy().Grouped())
+		return;
+	std::lock_guard l{dirtyMutex};
+	if (auto commits = Commits(); dirtyCommits != commits) {
+		dirty.clear();
+		dirtyCommits = commits;
+	}
+	dirty.insert(name);
+}
+
+SaveDB::~SaveDB() {
+	if (writer.joinable()) {
+		writer.request_stop();
+		writer.join();
+		// Files that failed to apply get one more try before they are lost.
+		std::unique_lock l{queueMutex};
+		for (auto& [name, file] : queued)
+			queue.push_back(name);
+		if (!queue.empty())
+			ApplyQueued(l);
+	}
+	BlobCache::Instance().Clear(this);
+	idleReaders.clear();
+	Close();
+	std::error_code ec;
+	if (fs::is_empty(Path().parent_path(), ec))
+		fs::remove(Path().parent_path(), ec);
+}
@@ -0,0 +1,60 @@
+#include "Shards.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+
+#include "ChunkKey.h"
+#include "Hash.h"
+#include "SQLite.h"
+#include "SaveDB.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+namespace {
+	// Chunks share a shard in squares of 1 << regionBits chunks a side. Part of
+	// where every chunk is stored, so never to be changed.
+	constexpr unsigned regionBits = 3;
+} // namespace
+
+uint32_t ZomboidHook::ShardOf(std::string_view name, uint32_t count) noexcept {
+	if (count <= 1)
+		return 0;
+	Digest digest;
+	if (auto key = ChunkKey(name)) {
+		// The low bits of the interleaved coordinates place a chunk within its
+		// region, and the family above them is left out too.
+		auto coords = static_cast<uint64_t>(*key) &
+									((uint64_t{1} << 2 * chunkCoordBits) - 1);
+		auto region = coords >> 2 * regionBits;
+		std::array<uint8_t, sizeof(region)> bytes;
+		for (size_t i = 0; i < bytes.size(); ++i)
+			bytes[i] = static_cast<uint8_t>(region >> 8 * i);
+		digest = HashContent({bytes.data(), bytes.size()});
+	} else
+		digest = HashContent(
+				{reinterpret_cast<const uint8_t*>(name.data()), name.size()});
+	uint32_t value = 0;
+	for (size_t i = 0; i < sizeof(value); ++i)
+		value |= uint32_t{digest.bytes[i]} << 8 * i;
+	return value % count;
+}
+
+fs::path ZomboidHook::ShardPath(const fs::path& saveDir, uint32_t index) {
+	if (index == 0)
+		return saveDir / SaveDB::fileName;
+	auto name = fs::path{SaveDB::fileName};
+	return saveDir / (name.stem().string() + '.' + std::to_string(index) +
+										name.extension().string());
+}
+
+uint32_t ZomboidHook::ShardCount(const fs::path& saveDir) {
+	auto path = ShardPath(saveDir, 0);
+	if (!fs::exists(path))
+		return 1;
+	SQLSession db{path, SQLITE_OPEN_READONLY};
+	auto count = db[db.PrepareStatement("PRAGMA user_version")].Execute(
+			[](int64_t version) { return version; });
+	return static_cast<uint32_t>(std::max<int64_t>(count, 1));
+}
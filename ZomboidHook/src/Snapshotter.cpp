@@ -0,0 +1,168 @@
+#include "Snapshotter.h"
+
+#include <algorithm>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace std::string_literals;
+using namespace ZomboidHook;
+
+// UTC, so that names sort by age whatever the time zone.
+static std::string Timestamp() {
+	using Clock = std::chrono::system_clock;
+	auto now		= Clock::to_time_t(Clock::now());
+	std::tm utc;
+#ifdef _WIN32
+	gmtime_s(&utc, &now);
+#else
+	gmtime_r(&now, &utc);
+#endif
+	char buf[32];
+	return {buf, std::strftime(buf, sizeof(buf), "%Y%m%d-%H%M%S", &utc)};
+}
+
+Snapshotter::Snapshotter(std::vector<fs::path> sources,
+												 fs::path dir,
+												 SnapshotPolicy policy,
+												 VerifyFn verify) :
+		sources{std::move(sources)},
+		dir{std::move(dir)},
+		policy{std::move(policy)},
+		verify{std::move(verify)} {
+	if (this->policy.interval.count() > 0)
+		worker = std::jthread{[this](std::stop_token stop) {
+			Run(std::move(stop));
+		}};
+}
+
+fs::path Snapshotter::DirFor(const SnapshotPolicy& policy,
+														 const fs::path& saveDir) {
+	auto save = saveDir.has_filename() ? saveDir : saveDir.parent_path();
+	if (policy.dir.empty())
+		return save / "snapshots";
+	// Kept apart per save as Saves/<mode>/<save> would be.
+	return policy.dir / save.parent_path().filename() / save.filename();
+}
+
+bool Snapshotter::Pause(std::stop_token& stop,
+												std::chrono::milliseconds duration) {
+	std::unique_lock l{mutex};
+	wake.wait_for(l, stop, duration, [] { return false; });
+	return !stop.stop_requested();
+}
+
+SQLConn Snapshotter::Pin(const fs::path& source) {
+	SQLConn from{source, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX};
+	if (SQLITE_OK != sqlite3_exec(from,
+																"BEGIN; SELECT COUNT(1) FROM sqlite_master",
+																nullptr,
+																nullptr,
+																nullptr)) [[unlikely]]
+		throw std::runtime_error{"Failed to read "s + sqlite3_errmsg(from)};
+	return from;
+}
+
+void Snapshotter::Copy(SQLConn& from,
+											 const fs::path& to,
+											 std::stop_token& stop) {
+	SQLConn into{to};
+	std::unique_ptr<sqlite3_backup, decltype(&sqlite3_backup_finish)> backup{
+			sqlite3_backup_init(into, "main", from, "main"), sqlite3_backup_finish};
+	if (!backup) [[unlikely]]
+		throw std::runtime_error{"Failed to start backup "s +
+														 sqlite3_errmsg(into)};
+	for (;;) {
+		switch (sqlite3_backup_step(backup.get(), policy.pagesPerStep)) {
+			case SQLITE_DONE:
+				// The copy takes the WAL mode of the source along with its pages,
+				// which would leave it needing side files to be read.
+				if (SQLITE_OK != sqlite3_backup_finish(backup.release()) ||
+						SQLITE_OK != sqlite3_exec(into,
+																			"PRAGMA journal_mode=DELETE",
+																			nullptr,
+																			nullptr,
+																			nullptr)) [[unlikely]]
+					throw std::runtime_error{"Failed to finish backup "s +
+																	 sqlite3_errmsg(into)};
+				return;
+			case SQLITE_OK:
+			case SQLITE_BUSY:
+			case SQLITE_LOCKED:
+				break;
+			default:
+				throw std::runtime_error{"Failed to back up "s +
+																 sqlite3_errmsg(into)};
+		}
+		if (!Pause(stop, policy.stepPause))
+			throw std::runtime_error{"Snapshot cancelled"};
+	}
+}
+
+void Snapshotter::Verify(const fs::path& copy) {
+	SQLSession session{copy, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX};
+	// Reading the schema alone catches a copy that is not a database at all.
+	auto schema = session.PrepareStatement("SELECT COUNT(1) FROM sqlite_master");
+	if (!session[schema].Execute([](int64_t tables) { return tables > 0; }) ||
+			(verify && !verify(session))) [[unlikely]]
+		throw std::runtime_error{"Snapshot " + copy.string() + " is corrupt"};
+}
+
+void Snapshotter::Prune(const fs::path& source) {
+	auto prefix = source.stem().string() + '-';
+	std::vector<fs::path> taken;
+	for (auto& entry : fs::directory_iterator{dir})
+		if (auto name = entry.path().filename().string();
+				name.starts_with(prefix) && name.ends_with(".db"))
+			taken.push_back(entry.path());
+	if (taken.size() <= policy.keep)
+		return;
+	std::sort(taken.begin(), taken.end());
+	std::error_code ec;
+	for (auto i = taken.size() - policy.keep; i > 0; --i)
+		fs::remove(taken[i - 1], ec);
+}
+
+std::vector<fs::path> Snapshotter::Take(std::stop_token stop) {
+	fs::create_directories(dir);
+	auto timestamp = Timestamp();
+	std::vector<fs::path> paths;
+	for (auto& source : sources)
+		paths.push_back(dir / (source.stem().string() + '-' + timestamp + ".db"));
+	auto part			= [](fs::path path) { return path += ".part"; };
+	size_t renamed = 0;
+	try {
+		std::vector<SQLConn> pinned;
+		pinned.reserve(sources.size());
+		for (auto& source : sources)
+			pinned.push_back(Pin(source));
+		for (size_t i = 0; i < sources.size(); ++i) {
+			Copy(pinned[i], part(paths[i]), stop);
+			Verify(part(paths[i]));
+		}
+		for (; renamed < paths.size(); ++renamed)
+			fs::rename(part(paths[renamed]), paths[renamed]);
+	} catch (...) {
+		// Those renamed already go too, as a set missing a shard is of no use.
+		std::error_code ec;
+		for (size_t i = 0; i < paths.size(); ++i)
+			fs::remove(i < renamed ? paths[i] : part(paths[i]), ec);
+		throw;
+	}
+	for (auto& source : sources)
+		Prune(source);
+	return paths;
+}
+
+void Snapshotter::Run(std::stop_token stop) {
+	while (Pause(stop, policy.interval)) {
+		try {
+			Take(stop);
+		} catch (const std::exception&) {
+			// Tried again next interval; the last good snapshots are still kept.
+		}
+	}
+}
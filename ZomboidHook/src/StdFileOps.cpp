@@ -0,0 +1,62 @@
+#include "StdFileOps.h"
+
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+class BufferedFile : public IMemMappedFile {
+	std::vector<uint8_t> buf;
+
+public:
+	explicit BufferedFile(size_t len) : buf(len) {}
+
+	explicit BufferedFile(const fs::path& path) : buf(fs::file_size(path)) {
+		std::ifstream file{path, std::ios::binary};
+		if (!file.read(reinterpret_cast<char*>(buf.data()), buf.size()))
+				[[unlikely]]
+			throw std::runtime_error{"Failed to read " + path.string()};
+	}
+
+	uint8_t* data() noexcept override {
+		return buf.data();
+	}
+
+	size_t size() noexcept override {
+		return buf.size();
+	}
+};
+
+bool StdFileOps::FileExists(const fs::path& path) noexcept {
+	std::error_code ec;
+	return fs::exists(path, ec);
+}
+
+std::unique_ptr<IMemMappedFile> StdFileOps::MemMapFile(const fs::path& path) {
+	return std::make_unique<BufferedFile>(path);
+}
+
+// There is no portable shared mapping, so nothing outside sees this one.
+std::unique_ptr<IMemMappedFile>
+		StdFileOps::MapSharedFile(const fs::path&, size_t len) {
+	return std::make_unique<BufferedFile>(len);
+}
+
+FileTimes StdFileOps::GetFileTimes(const fs::path& path) {
+	using namespace std::chrono;
+	// Like stat, a file that is not on disk has no times rather than an error.
+	std::error_code ec;
+	auto lastWrite = fs::last_write_time(path, ec);
+	if (ec)
+		return {};
+	// file_clock only has to convert to either sys or utc time, so go via now.
+	auto written	= lastWrite - file_clock::now();
+	auto modified = system_clock::to_time_t(
+			system_clock::now() + duration_cast<system_clock::duration>(written));
+	return {.creationTime = modified,
+					.lastModified = modified,
+					.lastAccessed = modified};
+}
@@ -0,0 +1,102 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+static constexpr size_t flushBytes = 1 << 20;
+
+static std::FILE* OpenTrace(const fs::path& path, bool write) {
+#ifdef _WIN32
+	auto file = _wfopen(path.c_str(), write ? L"wb" : L"rb");
+#else
+	auto file = std::fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+	if (!file)
+		throw std::runtime_error{"Failed to open trace " + path.string()};
+	return file;
+}
+
+TraceWriter::TraceWriter(const fs::path& path) :
+		file{OpenTrace(path, true)} {
+	buf.reserve(flushBytes + sizeof(TraceRecord));
+	Append(traceMagic.data(), traceMagic.size());
+}
+
+void TraceWriter::Append(const void* data, size_t len) {
+	auto bytes = static_cast<const uint8_t*>(data);
+	buf.insert(buf.end(), bytes, bytes + len);
+}
+
+void TraceWriter::FlushLocked() noexcept {
+	// A trace is a diagnostic, so a full disk only cuts it short.
+	std::fwrite(buf.data(), 1, buf.size(), file);
+	buf.clear();
+}
+
+void TraceWriter::Write(TraceRecord record,
+												const fs::path& path,
+												Clock::time_point begin) {
+	auto end			 = Clock::now();
+	record.time		 = std::chrono::nanoseconds{begin - start}.count();
+	record.latency = static_cast<uint32_t>(
+			std::min<int64_t>(std::chrono::nanoseconds{end - begin}.count(),
+												std::numeric_limits<uint32_t>::max()));
+	std::lock_guard l{mutex};
+	auto [it, added] =
+			paths.try_emplace(path.native(), static_cast<uint32_t>(paths.size()));
+	if (added) {
+		auto name = path.u8string();
+		TraceRecord define{.path = it->second,
+											 .arg	 = static_cast<int64_t>(name.size())};
+		Append(&define, sizeof(define));
+		Append(name.data(), name.size());
+	}
+	record.path = it->second;
+	Append(&record, sizeof(record));
+	if (buf.size() >= flushBytes)
+		FlushLocked();
+}
+
+TraceWriter::~TraceWriter() {
+	FlushLocked();
+	std::fclose(file);
+}
+
+TraceReader::TraceReader(const fs::path& path) : file{OpenTrace(path, false)} {
+	std::array<char, traceMagic.size()> magic{};
+	if (std::fread(magic.data(), 1, magic.size(), file) != magic.size() ||
+			magic != traceMagic) {
+		std::fclose(file);
+		throw std::runtime_error{"Not a trace: " + path.string()};
+	}
+}
+
+std::optional<TraceRecord> TraceReader::Next() {
+	TraceRecord record;
+	while (std::fread(&record, sizeof(record), 1, file) == 1) {
+		if (record.op != TraceOp::PATH)
+			return record;
+		if (record.arg < 0 || record.path != paths.size())
+			throw std::runtime_error{"Corrupt trace"};
+		std::u8string name(static_cast<size_t>(record.arg), u8'\0');
+		if (std::fread(name.data(), 1, name.size(), file) != name.size())
+			throw std::runtime_error{"Truncated trace"};
+		paths.emplace_back(name);
+	}
+	// A trace cut short mid record, by a crash, just ends early.
+	return std::nullopt;
+}
+
+const fs::path& TraceReader::Path(uint32_t id) const {
+	if (id >= paths.size())
+		throw std::runtime_error{"Corrupt trace"};
+	return paths[id];
+}
+
+TraceReader::~TraceReader() {
+	std::fclose(file);
+}
@@ -0,0 +1,203 @@
+#include "TracingHandler.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+TracingHandler::TracingHandler(std::unique_ptr<IOSCallHandler> inner,
+															 const fs::path& tracePath) :
+		inner{std::move(inner)}, trace{tracePath} {}
+
+// Calls fn and records it with its intent. A call that throws is not recorded,
+// as it never returned to the frontend either.
+template <typename Fn>
+FileIntent
+TracingHandler::Record(TraceRecord record, const fs::path& path, Fn&& fn) {
+	auto begin		= TraceWriter::Clock::now();
+	auto intent		= fn(record);
+	record.intent = static_cast<uint8_t>(intent);
+	trace.Write(record, path, begin);
+	return intent;
+}
+
+bool TracingHandler::MayIntercept(PathView path) const noexcept {
+	return inner->MayIntercept(path);
+}
+
+FileIntent TracingHandler::FileOpenOnly(FileInfo info) {
+	return Record({.handle = info.handle, .op = TraceOp::OPEN_ONLY},
+								info.path,
+								[&](auto&) { return inner->FileOpenOnly(info); });
+}
+
+FileIntent TracingHandler::FileCreateOnly(FileInfo info) {
+	return Record({.handle = info.handle, .op = TraceOp::CREATE_ONLY},
+								info.path,
+								[&](auto&) { return inner->FileCreateOnly(info); });
+}
+
+FileIntent TracingHandler::FileOpenOrCreate(FileInfo info) {
+	return Record({.handle = info.handle, .op = TraceOp::OPEN_OR_CREATE},
+								info.path,
+								[&](auto&) { return inner->FileOpenOrCreate(info); });
+}
+
+FileIntent TracingHandler::FileCreateAndWipe(FileInfo info) {
+	return Record({.handle = info.handle, .op = TraceOp::CREATE_AND_WIPE},
+								info.path,
+								[&](auto&) { return inner->FileCreateAndWipe(info); });
+}
+
+FileIntent TracingHandler::FileOpenOnlyAndWipe(FileInfo info) {
+	return Record({.handle = info.handle, .op = TraceOp::OPEN_ONLY_AND_WIPE},
+								info.path,
+								[&](auto&) { return inner->FileOpenOnlyAndWipe(info); });
+}
+
+FileIntent
+TracingHandler::FileRead(FileInfo info, uint8_t* buf, uint32_t& readLen) {
+	TraceRecord record{
+			.handle = info.handle, .arg = readLen, .op = TraceOp::READ};
+	return Record(record, info.path, [&](auto& record) {
+		auto intent		= inner->FileRead(info, buf, readLen);
+		record.result = readLen;
+		return intent;
+	});
+}
+
+FileIntent TracingHandler::FileWrite(FileInfo info,
+																		 const uint8_t* buf,
+																		 uint32_t& writeLen) {
+	TraceRecord record{
+			.handle = info.handle, .arg = writeLen, .op = TraceOp::WRITE};
+	return Record(record, info.path, [&](auto& record) {
+		auto intent		= inner->FileWrite(info, buf, writeLen);
+		record.result = writeLen;
+		return intent;
+	});
+}
+
+FileIntent TracingHandler::FileReadAt(FileInfo info,
+																			uint8_t* buf,
+																			uint32_t& readLen,
+																			uint64_t offset) {
+	TraceRecord record{.handle = info.handle,
+										 .arg		 = static_cast<int64_t>(offset),
+										 .op		 = TraceOp::READ_AT};
+	return Record(record, info.path, [&](auto& record) {
+		auto intent		= inner->FileReadAt(info, buf, readLen, offset);
+		record.result = readLen;
+		return intent;
+	});
+}
+
+FileIntent TracingHandler::FileWriteAt(FileInfo info,
+																			 const uint8_t* buf,
+																			 uint32_t& writeLen,
+																			 uint64_t offset) {
+	TraceRecord record{.handle = info.handle,
+										 .arg		 = static_cast<int64_t>(offset),
+										 .op		 = TraceOp::WRITE_AT};
+	return Record(record, info.path, [&](auto& record) {
+		auto intent		= inner->FileWriteAt(info, buf, writeLen, offset);
+		record.result = writeLen;
+		return intent;
+	});
+}
+
+FileIntent TracingHandler::FileAppend(FileInfo info,
+																			const uint8_t* buf,
+																			uint32_t& writeLen) {
+	TraceRecord record{
+			.handle = info.handle, .arg = writeLen, .op = TraceOp::APPEND};
+	return Record(record, info.path, [&](auto& record) {
+		auto intent		= inner->FileAppend(info, buf, writeLen);
+		record.result = writeLen;
+		return intent;
+	});
+}
+
+FileIntent TracingHandler::FileFlush(FileInfo info) {
+	return Record({.handle = info.handle, .op = TraceOp::FLUSH},
+								info.path,
+								[&](auto&) { return inner->FileFlush(info); });
+}
+
+FileIntent
+TracingHandler::FileSeek(FileInfo info, SeekFrom pos, int64_t& distance) {
+	TraceRecord record{.handle = info.handle,
+										 .arg		 = distance,
+										 .op		 = TraceOp::SEEK,
+										 .mode	 = static_cast<uint8_t>(pos)};
+	return Record(record, info.path, [&](auto& record) {
+		auto intent		= inner->FileSeek(info, pos, distance);
+		record.result = distance;
+		return intent;
+	});
+}
+
+FileIntent TracingHandler::FileTruncateToCursor(FileInfo info) {
+	return Record({.handle = info.handle, .op = TraceOp::TRUNCATE_TO_CURSOR},
+								info.path,
+								[&](auto&) { return inner->FileTruncateToCursor(info); });
+}
+
+FileIntent TracingHandler::FileTruncate(FileInfo info, uint64_t len) {
+	TraceRecord record{.handle = info.handle,
+										 .arg		 = static_cast<int64_t>(len),
+										 .op		 = TraceOp::TRUNCATE};
+	return Record(record, info.path, [&](auto&) {
+		return inner->FileTruncate(info, len);
+	});
+}
+
+FileIntent TracingHandler::FileDelete(const fs::path& path) {
+	return Record({.op = TraceOp::DELETE}, path, [&](auto&) {
+		return inner->FileDelete(path);
+	});
+}
+
+FileIntent TracingHandler::FileSetAttrib(const fs::path& path) {
+	return Record({.op = TraceOp::SET_ATTRIB}, path, [&](auto&) {
+		return inner->FileSetAttrib(path);
+	});
+}
+
+FileIntent TracingHandler::FileGetSize(FileInfo info,
+																			 uint64_t& sizeOut,
+																			 bool isStateless) {
+	TraceRecord record{.handle = info.handle,
+										 .op		 = TraceOp::GET_SIZE,
+										 .mode	 = isStateless};
+	return Record(record, info.path, [&](auto& record) {
+		auto intent		= inner->FileGetSize(info, sizeOut, isStateless);
+		record.result = intent == FileIntent::SUCCEED ? sizeOut : 0;
+		return intent;
+	});
+}
+
+// The two below do not return an intent; theirs is recorded in its place.
+FileAttribute TracingHandler::FileGetAttrib(const fs::path& path) {
+	auto attrib = FileAttribute::PASSTHRU;
+	Record({.op = TraceOp::GET_ATTRIB}, path, [&](auto&) {
+		attrib = inner->FileGetAttrib(path);
+		return static_cast<FileIntent>(attrib);
+	});
+	return attrib;
+}
+
+FileTimes TracingHandler::FileGetTimes(const fs::path& path) {
+	FileTimes times{};
+	Record({.op = TraceOp::GET_TIMES}, path, [&](auto& record) {
+		times					= inner->FileGetTimes(path);
+		record.result = times.lastModified;
+		return FileIntent::SUCCEED;
+	});
+	return times;
+}
+
+void TracingHandler::FileClosed(FileInfo info) {
+	Record({.handle = info.handle, .op = TraceOp::CLOSED}, info.path, [&](auto&) {
+		inner->FileClosed(info);
+		return FileIntent::SUCCEED;
+	});
+}
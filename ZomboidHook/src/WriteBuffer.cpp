@@ -0,0 +1,42 @@
+#include "WriteBuffer.h"
+
+#include <algorithm>
+
+using namespace ZomboidHook;
+
+void WriteBuffer::Assign(std::vector<uint8_t>&& buf, uint64_t at) noexcept {
+	data = std::move(buf);
+	base = at;
+}
+
+void WriteBuffer::Prepend(const std::vector<uint8_t>& head) {
+	data.insert(data.begin(), head.begin(), head.end());
+	base = 0;
+}
+
+std::vector<uint8_t>& WriteBuffer::Bytes() noexcept {
+	return data;
+}
+
+void WriteBuffer::Write(const uint8_t* buf, size_t len, size_t offset) {
+	offset -= base;
+	if (offset + len > data.size())
+		data.resize(offset + len); // Gaps past the old end read back as zeroes.
+	std::copy(buf, buf + len, data.begin() + offset);
+}
+
+void WriteBuffer::Resize(size_t len) {
+	data.resize(len - base);
+}
+
+std::pair<const uint8_t*, size_t> WriteBuffer::Data() const noexcept {
+	return {data.data(), data.size()};
+}
+
+uint64_t WriteBuffer::Base() const noexcept {
+	return base;
+}
+
+uint64_t WriteBuffer::Size() const noexcept {
+	return base + data.size();
+}
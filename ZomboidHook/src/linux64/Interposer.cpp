@@ -0,0 +1,750 @@
+// Fortified headers wrap some of these calls in inline functions of the same
+// name, which would clash with the definitions at the bottom of this file.
+#undef _FORTIFY_SOURCE
+
+#include "linux64/Interposer.h"
+
+#include <dlfcn.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdarg>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+static_assert(sizeof(off_t) == sizeof(off64_t) &&
+									sizeof(struct stat) == sizeof(struct stat64),
+							"The *64 calls are forwarded as is, so only LP64 is supported");
+
+static fs::path ResolvePath(int dirFd, const char* file) {
+	std::error_code ec;
+	fs::path path = file;
+	if (path.is_relative() && dirFd != AT_FDCWD)
+		path = fs::read_symlink("/proc/self/fd/" + std::to_string(dirFd), ec) /
+					 path;
+	return fs::absolute(path, ec).lexically_normal();
+}
+
+static uint32_t ClampLen(size_t count) noexcept {
+	return std::min<size_t>(count, std::numeric_limits<uint32_t>::max());
+}
+
+static void FillStat(struct stat& buf,
+										 const fs::path& path,
+										 uint64_t size,
+										 mode_t type,
+										 const FileTimes& times) {
+	buf								 = {};
+	buf.st_ino				 = std::hash<std::string>{}(path.string());
+	buf.st_mode				 = type | 0644;
+	buf.st_nlink			 = 1;
+	buf.st_uid				 = getuid();
+	buf.st_gid				 = getgid();
+	buf.st_size				 = static_cast<off_t>(size);
+	buf.st_blksize		 = 4096;
+	buf.st_blocks			 = static_cast<blkcnt_t>((size + 511) / 512);
+	buf.st_atim.tv_sec = times.lastAccessed;
+	buf.st_mtim.tv_sec = times.lastModified;
+	buf.st_ctim.tv_sec = times.creationTime;
+}
+
+static void FillStatX(struct statx& buf, const struct stat& from) {
+	buf									= {};
+	buf.stx_mask				= STATX_BASIC_STATS;
+	buf.stx_blksize			= from.st_blksize;
+	buf.stx_nlink				= from.st_nlink;
+	buf.stx_uid					= from.st_uid;
+	buf.stx_gid					= from.st_gid;
+	buf.stx_mode				= static_cast<uint16_t>(from.st_mode);
+	buf.stx_ino					= from.st_ino;
+	buf.stx_size				= from.st_size;
+	buf.stx_blocks			= from.st_blocks;
+	buf.stx_atime.tv_sec = from.st_atim.tv_sec;
+	buf.stx_mtime.tv_sec = from.st_mtim.tv_sec;
+	buf.stx_ctime.tv_sec = from.st_ctim.tv_sec;
+}
+
+template <typename T>
+static T* Next(const char* name) noexcept {
+	return reinterpret_cast<T*>(dlsym(RTLD_NEXT, name));
+}
+
+class ReservedFd { // We use eventfd() to obtain a unique descriptor to avoid
+									 // conflicts, like CreateEvent() on Windows.
+	int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+public:
+	ReservedFd() noexcept									= default;
+	ReservedFd(const ReservedFd&)					= delete;
+	ReservedFd& operator=(const ReservedFd&) = delete;
+
+	[[nodiscard]] bool Valid() const noexcept {
+		return fd >= 0;
+	}
+
+	int Release() noexcept {
+		return std::exchange(fd, -1);
+	}
+
+	operator int64_t() const noexcept {
+		return fd;
+	}
+
+	~ReservedFd() {
+		if (fd >= 0)
+			Interposer::Libc().close(fd);
+	}
+};
+
+class MemMappedFile : public IMemMappedFile {
+	uint8_t* buf = nullptr;
+	size_t len	 = 0;
+
+public:
+	MemMappedFile(const fs::path& path, const LibcFunctions& real) {
+		auto fd = real.openat(AT_FDCWD, path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) [[unlikely]]
+			throw std::runtime_error{"Failed to open " + path.string()};
+		struct stat info {};
+		if (real.fstat(fd, &info) == 0 && info.st_size > 0) {
+			auto map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map != MAP_FAILED) {
+				buf = static_cast<uint8_t*>(map);
+				len = info.st_size;
+			}
+		}
+		real.close(fd);
+		if (!buf && info.st_size > 0) [[unlikely]]
+			throw std::runtime_error{"Failed to map " + path.string()};
+	}
+
+	uint8_t* data() noexcept override {
+		return buf;
+	}
+
+	size_t size() noexcept override {
+		return len;
+	}
+
+	~MemMappedFile() override {
+		if (buf)
+			munmap(buf, len);
+	}
+};
+
+class SharedMappedFile : public IMemMappedFile {
+	uint8_t* buf = nullptr;
+	size_t len;
+
+public:
+	SharedMappedFile(const fs::path& path,
+									 size_t len,
+									 const LibcFunctions& real) :
+			len{len} {
+		auto fd =
+				real.openat(AT_FDCWD, path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0) [[unlikely]]
+			throw std::runtime_error{"Failed to open " + path.string()};
+		if (real.ftruncate(fd, len) == 0) {
+			auto map =
+					mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (map != MAP_FAILED)
+				buf = static_cast<uint8_t*>(map);
+		}
+		real.close(fd);
+		if (!buf) [[unlikely]]
+			throw std::runtime_error{"Failed to map " + path.string()};
+	}
+
+	uint8_t* data() noexcept override {
+		return buf;
+	}
+
+	size_t size() noexcept override {
+		return len;
+	}
+
+	~SharedMappedFile() override {
+		munmap(buf, len);
+	}
+};
+
+LibcFunctions::LibcFunctions() noexcept :
+		openat{Next<decltype(::openat)>("openat")},
+		read{Next<decltype(::read)>("read")},
+		pread{Next<decltype(::pread)>("pread")},
+		write{Next<decltype(::write)>("write")},
+		pwrite{Next<decltype(::pwrite)>("pwrite")},
+		lseek{Next<decltype(::lseek)>("lseek")},
+		fstat{Next<decltype(::fstat)>("fstat")},
+		stat{Next<decltype(::stat)>("stat")},
+		fstatat{Next<decltype(::fstatat)>("fstatat")},
+		statx{Next<decltype(::statx)>("statx")},
+		ftruncate{Next<decltype(::ftruncate)>("ftruncate")},
+		unlink{Next<decltype(::unlink)>("unlink")},
+		remove{Next<decltype(::remove)>("remove")},
+		close{Next<decltype(::close)>("close")},
+		fsync{Next<decltype(::fsync)>("fsync")},
+		fdatasync{Next<decltype(::fdatasync)>("fdatasync")} {}
+
+// Both are function statics since the game's libraries can call in before
+// this library's own static constructors have run. The instance is never
+// destroyed, as calls keep coming in until the process is gone.
+Interposer& Interposer::Instance() noexcept {
+	static auto& instance = *new Interposer;
+	return instance;
+}
+
+const LibcFunctions& Interposer::Libc() noexcept {
+	static const LibcFunctions libc;
+	return libc;
+}
+
+Interposer::Interposer() noexcept = default;
+
+void Interposer::RegisterHandler(std::unique_ptr<IOSCallHandler>&& newHandler) {
+	std::unique_lock l{handlerMutex};
+	assert(!oscHandler);
+	oscHandler = std::move(newHandler);
+}
+
+void Interposer::UnregisterHandler() noexcept {
+	std::unique_ptr<IOSCallHandler> handler;
+	{
+		std::unique_lock l{handlerMutex};
+		handler = std::move(oscHandler);
+	}
+	// Closing the databases opens and unlinks files, which takes handlerMutex
+	// again, so the handler only goes once the lock is released.
+}
+
+bool Interposer::FileExists(const fs::path& path) noexcept {
+	struct stat buf;
+	return Libc().stat(path.c_str(), &buf) == 0;
+}
+
+std::unique_ptr<IMemMappedFile> Interposer::MemMapFile(const fs::path& path) {
+	return std::make_unique<MemMappedFile>(path, Libc());
+}
+
+std::unique_ptr<IMemMappedFile>
+		Interposer::MapSharedFile(const fs::path& path, size_t len) {
+	return std::make_unique<SharedMappedFile>(path, len, Libc());
+}
+
+FileTimes Interposer::GetFileTimes(const fs::path& path) {
+	struct stat buf {};
+	Libc().stat(path.c_str(), &buf);
+	// There is no creation time in struct stat, the change time is closest.
+	return {.creationTime = buf.st_ctime,
+					.lastModified = buf.st_mtime,
+					.lastAccessed = buf.st_atime};
+}
+
+Interposer::LockedFd Interposer::Find(int fd) {
+	auto ref = interceptedFds.Find(fd);
+	if (!ref) [[likely]]
+		return {};
+	HandlerLock l{handlerMutex};
+	if (!oscHandler) [[unlikely]]
+		return {};
+	return {std::move(ref), std::move(l)};
+}
+
+// Asks the handler, so the caller must hold handlerMutex. Rules out nearly
+// every path without allocating.
+bool Interposer::MayIntercept(const char* file) const noexcept {
+	return file && oscHandler && oscHandler->MayIntercept(file);
+}
+
+int Interposer::Open(int dirFd, const char* file, int flags, mode_t mode) {
+	if (!file || (flags & O_DIRECTORY)) [[unlikely]]
+		return Libc().openat(dirFd, file, flags, mode);
+	HandlerLock l{handlerMutex};
+	if (!MayIntercept(file)) [[likely]]
+		return Libc().openat(dirFd, file, flags, mode);
+	ReservedFd rfd;
+	if (!rfd.Valid()) [[unlikely]]
+		return Libc().openat(dirFd, file, flags, mode);
+	auto path		= ResolvePath(dirFd, file);
+	auto intent = FileIntent::PASSTHRU;
+	if ((flags & O_CREAT) && (flags & O_EXCL))
+		intent = oscHandler->FileCreateOnly({path, rfd});
+	else if ((flags & O_CREAT) && (flags & O_TRUNC))
+		intent = oscHandler->FileCreateAndWipe({path, rfd});
+	else if (flags & O_CREAT)
+		intent = oscHandler->FileOpenOrCreate({path, rfd});
+	else if (flags & O_TRUNC)
+		intent = oscHandler->FileOpenOnlyAndWipe({path, rfd});
+	else
+		intent = oscHandler->FileOpenOnly({path, rfd});
+	switch (intent) {
+		case FileIntent::SUCCEED: {
+			auto fd	 = rfd.Release();
+			auto ref = interceptedFds.Emplace(
+					fd,
+					InterceptedFd{std::move(path), (flags & O_APPEND) != 0});
+			return fd;
+		}
+		case FileIntent::FAIL:
+			errno = (flags & O_EXCL) ? EEXIST : ENOENT;
+			return -1;
+		case FileIntent::PASSTHRU:
+			break;
+	}
+	return Libc().openat(dirFd, file, flags, mode);
+}
+
+ssize_t Interposer::Read(int fd, void* buf, size_t count) {
+	if (auto file = Find(fd)) {
+		auto len = ClampLen(count);
+		switch (oscHandler->FileRead({file->path, fd},
+																 static_cast<uint8_t*>(buf),
+																 len)) {
+			case FileIntent::SUCCEED:
+				return len;
+			case FileIntent::FAIL:
+				errno = EIO;
+				return -1;
+			case FileIntent::PASSTHRU:
+				break;
+		}
+	}
+	return Libc().read(fd, buf, count);
+}
+
+ssize_t Interposer::PRead(int fd, void* buf, size_t count, off_t offset) {
+	if (auto file = Find(fd)) {
+		if (offset < 0) [[unlikely]] {
+			errno = EINVAL;
+			return -1;
+		}
+		auto len = ClampLen(count);
+		switch (oscHandler->FileReadAt(
+				{file->path, fd}, static_cast<uint8_t*>(buf), len, offset)) {
+			case FileIntent::SUCCEED:
+				return len;
+			case FileIntent::FAIL:
+				errno = EIO;
+				return -1;
+			case FileIntent::PASSTHRU:
+				break;
+		}
+	}
+	return Libc().pread(fd, buf, count, offset);
+}
+
+ssize_t Interposer::Write(int fd, const void* buf, size_t count) {
+	if (auto file = Find(fd)) {
+		FileInfo info{file->path, fd};
+		auto data		= static_cast<const uint8_t*>(buf);
+		auto len		= ClampLen(count);
+		auto intent = file->append ? oscHandler->FileAppend(info, data, len)
+															 : oscHandler->FileWrite(info, data, len);
+		switch (intent) {
+			case FileIntent::SUCCEED:
+				return len;
+			case FileIntent::FAIL:
+				errno = EIO;
+				return -1;
+			case FileIntent::PASSTHRU:
+				break;
+		}
+	}
+	return Libc().write(fd, buf, count);
+}
+
+ssize_t
+		Interposer::PWrite(int fd, const void* buf, size_t count, off_t offset) {
+	if (auto file = Find(fd)) {
+		if (offset < 0) [[unlikely]] {
+			errno = EINVAL;
+			return -1;
+		}
+		auto len = ClampLen(count);
+		switch (oscHandler->FileWriteAt(
+				{file->path, fd}, static_cast<const uint8_t*>(buf), len, offset)) {
+			case FileIntent::SUCCEED:
+				return len;
+			case FileIntent::FAIL:
+				errno = EIO;
+				return -1;
+			case FileIntent::PASSTHRU:
+				break;
+		}
+	}
+	return Libc().pwrite(fd, buf, count, offset);
+}
+
+off_t Interposer::LSeek(int fd, off_t offset, int whence) {
+	// SEEK_DATA and SEEK_HOLE are left to fail on the reserved descriptor.
+	if (auto file = Find(fd); file && whence <= SEEK_END) {
+		int64_t distance = offset;
+		auto from				 = whence == SEEK_SET		? SeekFrom::BEGIN
+											 : whence == SEEK_CUR ? SeekFrom::CURRENT
+																						: SeekFrom::END;
+		switch (oscHandler->FileSeek({file->path, fd}, from, distance)) {
+			case FileIntent::SUCCEED:
+				return distance;
+			case FileIntent::FAIL:
+				errno = EINVAL;
+				return -1;
+			case FileIntent::PASSTHRU:
+				break;
+		}
+	}
+	return Libc().lseek(fd, offset, whence);
+}
+
+FileIntent Interposer::StatFd(int fd, struct stat& buf) {
+	auto file = Find(fd);
+	if (!file) [[likely]]
+		return FileIntent::PASSTHRU;
+	uint64_t size;
+	auto intent = oscHandler->FileGetSize({file->path, fd}, size);
+	if (intent == FileIntent::SUCCEED)
+		FillStat(
+				buf, file->path, size, S_IFREG, oscHandler->FileGetTimes(file->path));
+	else if (intent == FileIntent::FAIL)
+		errno = EIO;
+	return intent;
+}
+
+FileIntent Interposer::StatAt(int dirFd,
+															const char* file,
+															int flags,
+															struct stat& buf) {
+	if ((flags & AT_EMPTY_PATH) && file && !*file)
+		return StatFd(dirFd, buf);
+	HandlerLock l{handlerMutex};
+	if (!MayIntercept(file)) [[likely]]
+		return FileIntent::PASSTHRU;
+	auto path = ResolvePath(dirFd, file);
+	// Asked first, as it migrates a file still on disk, whose size only the
+	// handler knows from then on.
+	auto attrib = oscHandler->FileGetAttrib(path);
+	switch (attrib) {
+		case FileAttribute::NOT_FOUND:
+			errno = ENOENT;
+			return FileIntent::FAIL;
+		case FileAttribute::PASSTHRU:
+			return FileIntent::PASSTHRU;
+		default:
+			break;
+	}
+	uint64_t size = 0;
+	if (attrib == FileAttribute::NORMAL) {
+		auto intent = oscHandler->FileGetSize({path, -1}, size, true);
+		if (intent == FileIntent::FAIL)
+			errno = ENOENT;
+		if (intent != FileIntent::SUCCEED)
+			return intent;
+	}
+	auto type = attrib == FileAttribute::DIRECTORY ? S_IFDIR : S_IFREG;
+	FillStat(buf, path, size, type, oscHandler->FileGetTimes(path));
+	return FileIntent::SUCCEED;
+}
+
+int Interposer::FStat(int fd, struct stat* buf) {
+	switch (StatFd(fd, *buf)) {
+		case FileIntent::SUCCEED:
+			return 0;
+		case FileIntent::FAIL:
+			return -1;
+		case FileIntent::PASSTHRU:
+			break;
+	}
+	return Libc().fstat(fd, buf);
+}
+
+int Interposer::FStatAt(int dirFd,
+												const char* file,
+												struct stat* buf,
+												int flags) {
+	switch (StatAt(dirFd, file, flags, *buf)) {
+		case FileIntent::SUCCEED:
+			return 0;
+		case FileIntent::FAIL:
+			return -1;
+		case FileIntent::PASSTHRU:
+			break;
+	}
+	return Libc().fstatat(dirFd, file, buf, flags);
+}
+
+int Interposer::Stat(const char* file, struct stat* buf) {
+	return FStatAt(AT_FDCWD, file, buf, 0);
+}
+
+int Interposer::LStat(const char* file, struct stat* buf) {
+	// Intercepted files are never symlinks, so this is no different to stat().
+	return FStatAt(AT_FDCWD, file, buf, AT_SYMLINK_NOFOLLOW);
+}
+
+int Interposer::StatX(int dirFd,
+											const char* file,
+											int flags,
+											unsigned int mask,
+											struct statx* buf) {
+	struct stat from;
+	switch (StatAt(dirFd, file, flags, from)) {
+		case FileIntent::SUCCEED:
+			FillStatX(*buf, from);
+			return 0;
+		case FileIntent::FAIL:
+			return -1;
+		case FileIntent::PASSTHRU:
+			break;
+	}
+	return Libc().statx(dirFd, file, flags, mask, buf);
+}
+
+int Interposer::FTruncate(int fd, off_t len) {
+	if (auto file = Find(fd)) {
+		switch (oscHandler->FileTruncate({file->path, fd}, len)) {
+			case FileIntent::SUCCEED:
+				return 0;
+			case FileIntent::FAIL:
+				errno = EIO;
+				return -1;
+			case FileIntent::PASSTHRU:
+				break;
+		}
+	}
+	return Libc().ftruncate(fd, len);
+}
+
+int Interposer::Unlink(const char* file, decltype(::unlink)* real) {
+	HandlerLock l{handlerMutex};
+	if (!MayIntercept(file)) [[likely]]
+		return real(file);
+	switch (oscHandler->FileDelete(ResolvePath(AT_FDCWD, file))) {
+		case FileIntent::SUCCEED:
+			return 0;
+		case FileIntent::FAIL:
+			errno = ENOENT;
+			return -1;
+		case FileIntent::PASSTHRU:
+			break;
+	}
+	return real(file);
+}
+
+int Interposer::Unlink(const char* file) {
+	return Unlink(file, Libc().unlink);
+}
+
+int Interposer::Remove(const char* file) {
+	// libc's remove() calls unlink() internally, out of reach of interposition.
+	return Unlink(file, Libc().remove);
+}
+
+int Interposer::Close(int fd) {
+	auto file = interceptedFds.Find(fd);
+	if (!file) [[likely]]
+		return Libc().close(fd);
+	// Releases the descriptor even if the handler throws. It is forgotten
+	// first, as the number is up for reuse as soon as it is closed.
+	struct Release {
+		HandleRegistry<InterceptedFd>::Ref& file;
+		int fd;
+
+		~Release() {
+			file.Erase();
+			Libc().close(fd);
+		}
+	} release{file, fd};
+	HandlerLock l{handlerMutex};
+	if (oscHandler)
+		oscHandler->FileClosed({file->path, fd});
+	return 0;
+}
+
+int Interposer::Sync(int fd, decltype(::fsync)* real) {
+	if (auto file = Find(fd)) {
+		switch (oscHandler->FileFlush({file->path, fd})) {
+			case FileIntent::SUCCEED:
+				return 0;
+			case FileIntent::FAIL:
+				errno = EIO;
+				return -1;
+			case FileIntent::PASSTHRU:
+				break;
+		}
+	}
+	return real(fd);
+}
+
+Interposer::~Interposer() {}
+
+static mode_t ModeArg(int flags, va_list args) {
+	return (flags & (O_CREAT | O_TMPFILE)) ? va_arg(args, mode_t) : 0;
+}
+
+// What the handler throws must not unwind into C, so callers see an I/O error.
+template <typename Fn>
+static auto Guarded(Fn&& fn) noexcept {
+	using Result = decltype(fn());
+	try {
+		return fn();
+	} catch (...) {
+		errno = EIO;
+		return Result{-1};
+	}
+}
+
+// The interposed entry points. The *64 variants are the same calls on LP64.
+extern "C" {
+	DLLEXPORT int open(const char* file, int flags, ...) {
+		va_list args;
+		va_start(args, flags);
+		auto mode = ModeArg(flags, args);
+		va_end(args);
+		return Guarded([&] {
+			return Interposer::Instance().Open(AT_FDCWD, file, flags, mode);
+		});
+	}
+
+	DLLEXPORT int openat(int dirFd, const char* file, int flags, ...) {
+		va_list args;
+		va_start(args, flags);
+		auto mode = ModeArg(flags, args);
+		va_end(args);
+		return Guarded(
+				[&] { return Interposer::Instance().Open(dirFd, file, flags, mode); });
+	}
+
+	DLLEXPORT ssize_t read(int fd, void* buf, size_t count) {
+		return Guarded([&] { return Interposer::Instance().Read(fd, buf, count); });
+	}
+
+	DLLEXPORT ssize_t pread(int fd, void* buf, size_t count, off_t offset) {
+		return Guarded(
+				[&] { return Interposer::Instance().PRead(fd, buf, count, offset); });
+	}
+
+	DLLEXPORT ssize_t write(int fd, const void* buf, size_t count) {
+		return Guarded(
+				[&] { return Interposer::Instance().Write(fd, buf, count); });
+	}
+
+	DLLEXPORT ssize_t
+			pwrite(int fd, const void* buf, size_t count, off_t offset) {
+		return Guarded(
+				[&] { return Interposer::Instance().PWrite(fd, buf, count, offset); });
+	}
+
+	DLLEXPORT off_t lseek(int fd, off_t offset, int whence) noexcept {
+		return Guarded(
+				[&] { return Interposer::Instance().LSeek(fd, offset, whence); });
+	}
+
+	DLLEXPORT int fstat(int fd, struct stat* buf) noexcept {
+		return Guarded([&] { return Interposer::Instance().FStat(fd, buf); });
+	}
+
+	DLLEXPORT int stat(const char* file, struct stat* buf) noexcept {
+		return Guarded([&] { return Interposer::Instance().Stat(file, buf); });
+	}
+
+	DLLEXPORT int lstat(const char* file, struct stat* buf) noexcept {
+		return Guarded([&] { return Interposer::Instance().LStat(file, buf); });
+	}
+
+	DLLEXPORT int fstatat(int dirFd,
+												const char* file,
+												struct stat* buf,
+												int flags) noexcept {
+		return Guarded([&] {
+			return Interposer::Instance().FStatAt(dirFd, file, buf, flags);
+		});
+	}
+
+	DLLEXPORT int statx(int dirFd,
+											const char* file,
+											int flags,
+											unsigned int mask,
+											struct statx* buf) noexcept {
+		return Guarded([&] {
+			return Interposer::Instance().StatX(dirFd, file, flags, mask, buf);
+		});
+	}
+
+	DLLEXPORT int ftruncate(int fd, off_t len) noexcept {
+		return Guarded([&] { return Interposer::Instance().FTruncate(fd, len); });
+	}
+
+	DLLEXPORT int unlink(const char* file) noexcept {
+		return Guarded([&] { return Interposer::Instance().Unlink(file); });
+	}
+
+	DLLEXPORT int remove(const char* file) noexcept {
+		return Guarded([&] { return Interposer::Instance().Remove(file); });
+	}
+
+	DLLEXPORT int close(int fd) {
+		return Guarded([&] { return Interposer::Instance().Close(fd); });
+	}
+
+	DLLEXPORT int fsync(int fd) {
+		return Guarded([&] {
+			return Interposer::Instance().Sync(fd, Interposer::Libc().fsync);
+		});
+	}
+
+	DLLEXPORT int fdatasync(int fd) {
+		return Guarded([&] {
+			return Interposer::Instance().Sync(fd, Interposer::Libc().fdatasync);
+		});
+	}
+
+	[[gnu::alias("open")]] DLLEXPORT int open64(const char*, int, ...);
+	[[gnu::alias("openat")]] DLLEXPORT int openat64(int, const char*, int, ...);
+	[[gnu::alias("pread")]] DLLEXPORT ssize_t
+			pread64(int, void*, size_t, off64_t);
+	[[gnu::alias("pwrite")]] DLLEXPORT ssize_t
+			pwrite64(int, const void*, size_t, off64_t);
+	[[gnu::alias("lseek")]] DLLEXPORT off64_t
+			lseek64(int, off64_t, int) noexcept;
+	[[gnu::alias("ftruncate")]] DLLEXPORT int ftruncate64(int, off64_t) noexcept;
+
+	DLLEXPORT int fstat64(int fd, struct stat64* buf) noexcept {
+		return fstat(fd, reinterpret_cast<struct stat*>(buf));
+	}
+
+	DLLEXPORT int stat64(const char* file, struct stat64* buf) noexcept {
+		return stat(file, reinterpret_cast<struct stat*>(buf));
+	}
+
+	DLLEXPORT int lstat64(const char* file, struct stat64* buf) noexcept {
+		return lstat(file, reinterpret_cast<struct stat*>(buf));
+	}
+
+	DLLEXPORT int fstatat64(int dirFd,
+													const char* file,
+													struct stat64* buf,
+													int flags) noexcept {
+		return fstatat(dirFd, file, reinterpret_cast<struct stat*>(buf), flags);
+	}
+
+	// Binaries built against glibc before 2.33 call these instead, with the
+	// version of struct stat, which has only ever had the one layout on LP64.
+	DLLEXPORT int __xstat64(int, const char* file, struct stat64* buf) noexcept {
+		return stat64(file, buf);
+	}
+
+	DLLEXPORT int __lxstat64(int, const char* file, struct stat64* buf) noexcept {
+		return lstat64(file, buf);
+	}
+
+	DLLEXPORT int __fxstat64(int, int fd, struct stat64* buf) noexcept {
+		return fstat64(fd, buf);
+	}
+}
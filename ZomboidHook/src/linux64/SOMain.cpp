@@ -0,0 +1,26 @@
+#include "Metrics.h"
+#include "OSCallHandler.h"
+#include "TracingHandler.h"
+#include "linux64/Interposer.h"
+
+using namespace ZomboidHook;
+
+[[gnu::constructor]] static void OnLoad() {
+	sqlite3_initialize();
+	auto config = Config::FromEnvironment();
+	if (!config.stats.empty())
+		Metrics::Instance().Export(Interposer::Instance(), config.stats);
+	std::unique_ptr<IOSCallHandler> handler =
+			std::make_unique<OSCallHandler>(Interposer::Instance(), config);
+	if (!config.trace.empty())
+		handler =
+				std::make_unique<TracingHandler>(std::move(handler), config.trace);
+	Interposer::Instance().RegisterHandler(std::move(handler));
+}
+
+[[gnu::destructor]] static void OnUnload() {
+	// Drop the handler first so that pending commits land before SQLite goes.
+	Interposer::Instance().UnregisterHandler();
+	Metrics::Instance().Close();
+	sqlite3_shutdown();
+}
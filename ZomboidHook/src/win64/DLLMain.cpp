@@ -1,22 +1,38 @@
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-
-#include "OSCallHandler.h"
-#include "win64/APIHijacker.h"
-
-using namespace ZomboidHook;
-
-DLLEXPORT BOOL WINAPI DllMain(HINSTANCE hInstance, DWORD fdwReason, LPVOID) {
-	switch (fdwReason) {
-		case DLL_PROCESS_ATTACH:
-			DisableThreadLibraryCalls(hInstance);
-			sqlite3_initialize();
-			APIHijacker::Instance().RegisterHandler(
-					std::make_unique<OSCallHandler>(APIHijacker::Instance()));
-			break;
-		case DLL_PROCESS_DETACH:
-			sqlite3_shutdown();
-			break;
-	}
-	return TRUE;
-}
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include "Metrics.h"
+#include "OSCallHandler.h"
+#include "TracingHandler.h"
+#include "win64/APIHijacker.h"
+
+using namespace ZomboidHook;
+
+static std::unique_ptr<IOSCallHandler> MakeHandler() {
+	auto config = Config::FromEnvironment();
+	if (!config.stats.empty())
+		Metrics::Instance().Export(APIHijacker::Instance(), config.stats);
+	std::unique_ptr<IOSCallHandler> handler =
+			std::make_unique<OSCallHandler>(APIHijacker::Instance(), config);
+	if (!config.trace.empty())
+		handler =
+				std::make_unique<TracingHandler>(std::move(handler), config.trace);
+	return handler;
+}
+
+DLLEXPORT BOOL WINAPI DllMain(HINSTANCE hInstance, DWORD fdwReason, LPVOID) {
+	switch (fdwReason) {
+		case DLL_PROCESS_ATTACH:
+			DisableThreadLibraryCalls(hInstance);
+			sqlite3_initialize();
+			APIHijacker::Instance().RegisterHandler(MakeHandler());
+			break;
+		case DLL_PROCESS_DETACH:
+			// Drop the handler first so that pending commits land before SQLite goes.
+			APIHijacker::Instance().UnregisterHandler();
+			Metrics::Instance().Close();
+			sqlite3_shutdown();
+			break;
+	}
+	return TRUE;
+}
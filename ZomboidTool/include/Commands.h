@@ -0,0 +1,15 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+
+namespace ZomboidTool {
+	using Args = std::span<const std::string_view>;
+
+	int Compact(Args args);
+	int Export(Args args);
+	int Migrate(Args args);
+	int Reshard(Args args);
+	int Snapshot(Args args);
+	int Stats(Args args);
+} // namespace ZomboidTool
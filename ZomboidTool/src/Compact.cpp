@@ -0,0 +1,52 @@
+#include "Commands.h"
+
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+#include "SQLite.h"
+#include "Shards.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+namespace {
+	// The database at path along with its WAL, if any.
+	uintmax_t DatabaseSize(const fs::path& path) {
+		uintmax_t size = 0;
+		for (auto suffix : {"", "-wal"}) {
+			auto file = path;
+			file += suffix;
+			std::error_code ec;
+			if (auto len = fs::file_size(file, ec); !ec)
+				size += len;
+		}
+		return size;
+	}
+} // namespace
+
+int ZomboidTool::Compact(Args args) {
+	if (args.empty()) {
+		std::cout << "no save directory given\n";
+		return 1;
+	}
+	for (auto arg : args) {
+		fs::path dir = arg;
+		for (uint32_t i = 0, count = ShardCount(dir); i < count; ++i) {
+			auto path	  = ShardPath(dir, i);
+			auto before = DatabaseSize(path);
+			{
+				SQLSession db{path, SQLITE_OPEN_READWRITE};
+				// Rebuilding the file is also what makes a database created before
+				// incremental vacuuming reclaim space in the background from then on.
+				if (!db.Execute("PRAGMA auto_vacuum=INCREMENTAL") ||
+						!db.Execute("VACUUM") ||
+						!db.Execute("PRAGMA wal_checkpoint(TRUNCATE)"))
+					throw std::runtime_error{"Failed to compact " + path.string()};
+			}
+			std::cout << path.string() << ": " << before << " -> "
+								<< DatabaseSize(path) << " bytes\n";
+		}
+	}
+	return 0;
+}
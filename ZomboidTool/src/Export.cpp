@@ -0,0 +1,59 @@
+#include "Commands.h"
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#include "BulkExporter.h"
+#include "StdFileOps.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+int ZomboidTool::Export(Args args) {
+	BulkExporter::Options options{
+			.writers = std::max(std::thread::hardware_concurrency(), 2u)};
+	fs::path into;
+	while (!args.empty()) {
+		if (args.size() >= 2 && args[0] == "--threads") {
+			std::from_chars(args[1].data(),
+											args[1].data() + args[1].size(),
+											options.writers);
+			args = args.subspan(2);
+		} else if (args.size() >= 2 && args[0] == "--into") {
+			into = args[1];
+			args = args.subspan(2);
+		} else if (args[0] == "--incremental") {
+			options.incremental = true;
+			args								= args.subspan(1);
+		} else
+			break;
+	}
+	if (args.empty()) {
+		std::cout << "no save directory given\n";
+		return 1;
+	}
+	auto report = [](const ExportProgress& p) {
+		std::cout << '\r' << p.filesDone + p.filesSkipped << " files, "
+							<< (p.bytesDone >> 20) << " MiB" << std::flush;
+	};
+	StdFileOps fileOps;
+	BulkExporter exporter{fileOps, options, report};
+	for (auto arg : args) {
+		fs::path dir = arg;
+		std::cout << dir.string() << '\n';
+		// Next to the database, or elsewhere in a folder per save.
+		auto save		= dir.has_filename() ? dir : dir.parent_path();
+		auto to			= into.empty() ? dir : into / save.filename();
+		auto result = exporter.Export(dir, to);
+		std::cout << '\r' << result.filesDone << " files exported";
+		if (result.filesSkipped)
+			std::cout << ", " << result.filesSkipped << " already up to date";
+		if (result.filesRemoved)
+			std::cout << ", " << result.filesRemoved << " deleted";
+		std::cout << '\n';
+	}
+	return 0;
+}
@@ -0,0 +1,53 @@
+#include "Commands.h"
+
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+#include <thread>
+
+#include "BulkMigrator.h"
+#include "StdFileOps.h"
+
+using namespace ZomboidHook;
+
+int ZomboidTool::Migrate(Args args) {
+	BulkMigrator::Options options{
+			.readers = std::max(std::thread::hardware_concurrency(), 2u)};
+	while (!args.empty()) {
+		if (args.size() >= 2 && args[0] == "--threads") {
+			std::from_chars(args[1].data(),
+											args[1].data() + args[1].size(),
+											options.readers);
+			args = args.subspan(2);
+		} else if (args.size() >= 2 && args[0] == "--shards") {
+			std::from_chars(args[1].data(),
+											args[1].data() + args[1].size(),
+											options.shards);
+			args = args.subspan(2);
+		} else if (args[0] == "--compress") {
+			options.codec = Codec::LZ;
+			args					= args.subspan(1);
+		} else
+			break;
+	}
+	if (args.empty()) {
+		std::cout << "no save directory given\n";
+		return 1;
+	}
+	auto report = [](const MigrationProgress& p) {
+		std::cout << '\r' << p.filesDone << '/' << p.filesTotal << " files, "
+							<< (p.bytesDone >> 20) << " MiB" << std::flush;
+	};
+	StdFileOps fileOps;
+	BulkMigrator migrator{fileOps, options, report};
+	for (auto dir : args) {
+		std::cout << dir << '\n';
+		auto result = migrator.Migrate(dir);
+		std::cout << '\r' << result.filesDone << '/' << result.filesTotal
+							<< " files migrated";
+		if (result.filesFailed)
+			std::cout << ", " << result.filesFailed << " could not be read";
+		std::cout << '\n';
+	}
+	return 0;
+}
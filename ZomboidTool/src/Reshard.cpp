@@ -0,0 +1,136 @@
+#include "Commands.h"
+
+#include <charconv>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "SaveDB.h"
+#include "Shards.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+using namespace std::string_literals;
+
+namespace {
+	constexpr size_t batchBytes = 64 << 20;
+
+	// Moves the database at from and its WAL files, if any, to to.
+	void MoveDatabase(const fs::path& from, const fs::path& to) {
+		for (auto suffix : {"", "-wal", "-shm"}) {
+			auto source = from;
+			source += suffix;
+			auto target = to;
+			target += suffix;
+			if (fs::exists(source))
+				fs::rename(source, target);
+		}
+	}
+
+	// Checked, so that a batch that failed to commit is never swapped in.
+	void ExecuteChecked(SaveDB& db, const char* sql) {
+		if (!db.Execute(sql)) [[unlikely]]
+			throw std::runtime_error{"Failed to "s + sql + " on " +
+															 db.Path().string()};
+	}
+} // namespace
+
+int ZomboidTool::Reshard(Args args) {
+	uint32_t shards = 0;
+	StorageOptions options;
+	while (!args.empty()) {
+		if (args.size() >= 2 && args[0] == "--shards") {
+			std::from_chars(
+					args[1].data(), args[1].data() + args[1].size(), shards);
+			args = args.subspan(2);
+		} else if (args[0] == "--compress") {
+			options.codec = Codec::LZ;
+			args					= args.subspan(1);
+		} else if (args[0] == "--segments") {
+			options.segmented = true;
+			args							= args.subspan(1);
+		} else
+			break;
+	}
+	if (shards < 1 || shards > 64) {
+		std::cout << "--shards must be between 1 and 64\n";
+		return 1;
+	}
+	if (args.empty()) {
+		std::cout << "no save directory given\n";
+		return 1;
+	}
+	options.shards = shards;
+	for (auto arg : args) {
+		fs::path dir = arg;
+		auto from		 = ShardCount(dir);
+		// The new shards are built aside and only swapped in once complete.
+		auto staging =
+				dir / (fs::path{SaveDB::fileName}.stem().string() + ".reshard");
+		fs::remove_all(staging);
+		fs::create_directories(staging);
+		size_t files = 0;
+		{
+			std::vector<std::unique_ptr<SaveDB>> to;
+			for (uint32_t i = 0; i < shards; ++i) {
+				to.push_back(std::make_unique<SaveDB>(
+						ShardPath(staging, i),
+						CommitPolicy{.durability = Durability::PER_OP},
+						options));
+				to.back()->Execute("PRAGMA synchronous=OFF");
+			}
+			try {
+				for (auto& db : to)
+					ExecuteChecked(*db, "BEGIN");
+				size_t bytes = 0;
+				for (uint32_t i = 0; i < from; ++i) {
+					SaveDB source{ShardPath(dir, i),
+												{.durability = Durability::PER_OP},
+												{.shards = from}};
+					source.ForEachFile([&](auto& name, auto data) {
+						auto& target = *to[ShardOf(name, shards)];
+						if (data)
+							target.PutBlob(name, {data->data(), data->size()});
+						else {
+							// Deleted files stay deleted rather than being migrated again
+							// from a legacy file left on disk.
+							target.PutBlob(name, {nullptr, 0});
+							target.DeleteBlob(name);
+						}
+						++files;
+						if ((bytes += data ? data->size() : 0) < batchBytes)
+							return;
+						for (auto& db : to) {
+							ExecuteChecked(*db, "COMMIT");
+							ExecuteChecked(*db, "BEGIN");
+						}
+						bytes = 0;
+					});
+				}
+				for (auto& db : to)
+					ExecuteChecked(*db, "COMMIT");
+			} catch (...) {
+				for (auto& db : to)
+					db->Execute("ROLLBACK"); // Unless SQLite has already.
+				throw;
+			}
+			for (auto& db : to) {
+				db->Execute("PRAGMA synchronous=NORMAL");
+				db->Execute("PRAGMA wal_checkpoint(TRUNCATE)");
+			}
+		}
+		auto old = staging / "old";
+		fs::create_directories(old);
+		for (uint32_t i = 0; i < from; ++i)
+			MoveDatabase(ShardPath(dir, i), old / ShardPath(dir, i).filename());
+		for (uint32_t i = 0; i < shards; ++i)
+			MoveDatabase(ShardPath(staging, i), ShardPath(dir, i));
+		fs::remove_all(staging);
+		std::cout << dir.string() << ": " << files << " files moved from " << from
+							<< " to " << shards << " shards\n";
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+#include "Commands.h"
+
+#include <charconv>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include "SaveDB.h"
+#include "Shards.h"
+#include "Snapshotter.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+int ZomboidTool::Snapshot(Args args) {
+	SnapshotPolicy policy;
+	while (!args.empty()) {
+		if (args.size() >= 2 && args[0] == "--keep") {
+			std::from_chars(
+					args[1].data(), args[1].data() + args[1].size(), policy.keep);
+			args = args.subspan(2);
+		} else if (args.size() >= 2 && args[0] == "--into") {
+			policy.dir = args[1];
+			args			 = args.subspan(2);
+		} else
+			break;
+	}
+	if (args.empty()) {
+		std::cout << "no save directory given\n";
+		return 1;
+	}
+	for (auto arg : args) {
+		fs::path dir = arg;
+		std::vector<fs::path> shards;
+		for (uint32_t i = 0, count = ShardCount(dir); i < count; ++i)
+			shards.push_back(ShardPath(dir, i));
+		Snapshotter snapshotter{std::move(shards),
+														Snapshotter::DirFor(policy, dir),
+														policy,
+														SaveDB::Verify};
+		for (auto& path : snapshotter.Take())
+			std::cout << path.string() << '\n';
+	}
+	return 0;
+}
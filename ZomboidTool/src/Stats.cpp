@@ -0,0 +1,184 @@
+#include "Commands.h"
+
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <thread>
+
+#include "Metrics.h"
+
+namespace fs = std::filesystem;
+using namespace ZomboidHook;
+
+namespace {
+	// A copy of a stats file as it was when read. The counters are read one by
+	// one while the hook updates them, so figures may be a call apart.
+	class Sample {
+		alignas(MetricsBlock) std::array<std::byte, sizeof(MetricsBlock)> raw;
+
+	public:
+		bool Read(const fs::path& path) {
+			std::ifstream file{path, std::ios::binary};
+			if (!file.read(reinterpret_cast<char*>(raw.data()), raw.size()))
+				return false;
+			auto& block = Block();
+			return block.magic == MetricsBlock::magicValue &&
+						 block.version == MetricsBlock::versionValue &&
+						 block.size == sizeof(MetricsBlock);
+		}
+
+		[[nodiscard]] const MetricsBlock& Block() const noexcept {
+			return *reinterpret_cast<const MetricsBlock*>(raw.data());
+		}
+	};
+
+	uint64_t Load(const std::atomic<uint64_t>& value) {
+		return value.load(std::memory_order_relaxed);
+	}
+
+	// The latest running process, going by when each file was started.
+	std::optional<fs::path> Newest() {
+		std::optional<fs::path> newest;
+		int64_t started = 0;
+		std::error_code ec;
+		for (auto& entry : fs::directory_iterator{fs::temp_directory_path(), ec}) {
+			auto name = entry.path().filename().string();
+			if (!name.starts_with("ZomboidDB-") || !name.ends_with(".stats"))
+				continue;
+			Sample sample;
+			if (sample.Read(entry.path()) && sample.Block().started >= started) {
+				started = sample.Block().started;
+				newest	= entry.path();
+			}
+		}
+		return newest;
+	}
+
+	// Counts between two samples of one histogram.
+	struct Delta {
+		const LatencyHistogram& now;
+		const LatencyHistogram* before;
+
+		uint64_t operator()(const std::atomic<uint64_t> LatencyHistogram::*field)
+				const {
+			return Load(now.*field) - (before ? Load(before->*field) : 0);
+		}
+
+		uint64_t Bucket(size_t i) const {
+			return Load(now.counts[i]) - (before ? Load(before->counts[i]) : 0);
+		}
+
+		// The floor of the bucket holding quantile q, in microseconds.
+		double Quantile(double q) const {
+			auto count = (*this)(&LatencyHistogram::count);
+			auto rank	 = static_cast<uint64_t>(q * (count - 1));
+			uint64_t seen = 0;
+			for (size_t i = 0; i < LatencyHistogram::buckets; ++i) {
+				seen += Bucket(i);
+				if (seen > rank)
+					return LatencyHistogram::Floor(i) / 1000.0;
+			}
+			return 0;
+		}
+	};
+
+	void Print(std::ostream& out,
+						 const MetricsBlock& now,
+						 const MetricsBlock* before,
+						 double seconds) {
+		out << std::left << std::setw(20) << "op" << std::right << std::setw(10)
+				<< "calls" << std::setw(10) << "calls/s" << std::setw(10) << "mean_us"
+				<< std::setw(10) << "p50_us" << std::setw(10) << "p99_us"
+				<< std::setw(10) << "p999_us" << std::setw(10) << "MiB" << '\n'
+				<< std::fixed << std::setprecision(1);
+		for (size_t op = 0; op < now.ops.size(); ++op) {
+			Delta delta{now.ops[op], before ? &before->ops[op] : nullptr};
+			auto count = delta(&LatencyHistogram::count);
+			if (count == 0)
+				continue;
+			auto mean = delta(&LatencyHistogram::totalNs) / 1000.0 / count;
+			out << std::left << std::setw(20) << metricNames[op] << std::right
+					<< std::setw(10) << count << std::setw(10) << count / seconds
+					<< std::setw(10) << mean << std::setw(10) << delta.Quantile(0.5)
+					<< std::setw(10) << delta.Quantile(0.99) << std::setw(10)
+					<< delta.Quantile(0.999) << std::setw(10)
+					<< delta(&LatencyHistogram::bytes) / double(1 << 20) << '\n';
+		}
+
+		auto diff = [&](const std::atomic<uint64_t> MetricsBlock::*field) {
+			return Load(now.*field) - (before ? Load(before->*field) : 0);
+		};
+		auto requested = diff(&MetricsBlock::bytesRequested);
+		auto stored		 = diff(&MetricsBlock::bytesStored);
+		auto hits			 = diff(&MetricsBlock::cacheHits);
+		auto misses		 = diff(&MetricsBlock::cacheMisses);
+		out << "\nwritten by the game " << requested / double(1 << 20)
+				<< " MiB, stored " << stored / double(1 << 20) << " MiB";
+		if (requested > 0)
+			out << " (" << std::setprecision(2) << double(stored) / requested
+					<< "x)" << std::setprecision(1);
+		out << "\npage cache " << hits << " hits, " << misses << " misses";
+		if (hits + misses > 0)
+			out << " (" << 100.0 * hits / (hits + misses) << "% hit)";
+		out << ", " << diff(&MetricsBlock::cacheWrites) << " pages written";
+		auto blobHits		= diff(&MetricsBlock::blobHits);
+		auto blobMisses = diff(&MetricsBlock::blobMisses);
+		out << "\nblob cache " << blobHits << " hits, " << blobMisses << " misses";
+		if (blobHits + blobMisses > 0)
+			out << " (" << 100.0 * blobHits / (blobHits + blobMisses) << "% hit)";
+		out << ", " << Load(now.blobCached) / double(1 << 20) << " MiB held\n";
+	}
+} // namespace
+
+int ZomboidTool::Stats(Args args) {
+	std::chrono::milliseconds interval{1000};
+	auto once = false;
+	while (!args.empty()) {
+		if (args.size() >= 2 && args[0] == "--interval") {
+			auto ms = interval.count();
+			std::from_chars(args[1].data(), args[1].data() + args[1].size(), ms);
+			interval = std::chrono::milliseconds{std::max<int64_t>(ms, 1)};
+			args		 = args.subspan(2);
+		} else if (args[0] == "--once") {
+			once = true;
+			args = args.subspan(1);
+		} else
+			break;
+	}
+	auto path = args.empty() ? Newest() : fs::path{args[0]};
+	Sample first;
+	if (!path || !first.Read(*path)) {
+		std::cout << "no stats file found\n";
+		return 1;
+	}
+	if (once) {
+		using std::chrono::system_clock;
+		std::chrono::duration<double> uptime =
+				system_clock::now() - system_clock::from_time_t(first.Block().started);
+		Print(std::cout, first.Block(), nullptr, uptime.count());
+		return 0;
+	}
+
+	// Like top: every interval shows what happened during the last one.
+	auto before = std::make_unique<Sample>(first);
+	auto now		= std::make_unique<Sample>();
+	for (;;) {
+		std::this_thread::sleep_for(interval);
+		if (!now->Read(*path)) {
+			std::cout << "the process has exited\n";
+			return 0;
+		}
+		std::cout << "\x1b[H\x1b[2J" << path->string() << "\n\n";
+		Print(std::cout,
+					now->Block(),
+					&before->Block(),
+					std::chrono::duration<double>{interval}.count());
+		std::cout << std::flush;
+		std::swap(before, now);
+	}
+}
@@ -0,0 +1,49 @@
+#include "Commands.h"
+
+#include <exception>
+#include <iostream>
+#include <vector>
+
+#include "sqlite3.h"
+
+using namespace ZomboidTool;
+
+static int Usage() {
+	std::cout << "usage: ZomboidTool <command> [args]\n"
+							 "  migrate [--threads N] [--compress] [--shards N]\n"
+							 "          <save dir>...\n"
+							 "  compact <save dir>...\n"
+							 "  export [--threads N] [--incremental] [--into dir]\n"
+							 "         <save dir>...\n"
+							 "  reshard --shards N [--compress] [--segments] <save dir>...\n"
+							 "  snapshot [--keep N] [--into dir] <save dir>...\n"
+							 "  stats [--interval ms] [--once] [stats file]\n";
+	return 1;
+}
+
+int main(int argc, const char* const argv[]) {
+	std::vector<std::string_view> args{argv + 1, argv + argc};
+	if (args.empty())
+		return Usage();
+	sqlite3_initialize();
+	auto command = args.front();
+	auto rest		 = Args{args}.subspan(1);
+	try {
+		if (command == "migrate")
+			return Migrate(rest);
+		if (command == "compact")
+			return Compact(rest);
+		if (command == "export")
+			return Export(rest);
+		if (command == "reshard")
+			return Reshard(rest);
+		if (command == "snapshot")
+			return Snapshot(rest);
+		if (command == "stats")
+			return Stats(rest);
+	} catch (const std::exception& e) {
+		std::cout << command << " failed: " << e.what() << '\n';
+		return 2;
+	}
+	return Usage();
+}